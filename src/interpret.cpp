@@ -15,38 +15,38 @@ namespace Mini_C::interpret
 	/*
 	 * If no such `_name` exists, throw Env_Ex.
 	 */
-	value_t Env::find(const lexer::identifier& _name)
+	value_t Env::find(util::symbol_t _name)
 	{
 		auto it = _env.find(_name);
 		if (it != _env.end()) return it->second;
-		throw std::string("The variable \"") + _name + "\" has not been defined.";
+		throw std::string("The variable \"") + std::string(util::symbols().name(_name)) + "\" has not been defined.";
 	}
 
 	/*
 	 * If such `_name` exists, throw Env_Ex.
 	 */
-	void Env::insert(const lexer::identifier& _name, const value_t& _value)
+	void Env::insert(util::symbol_t _name, const value_t& _value)
 	{
 		if (_env.find(_name) == _env.end())
 			_env.insert(std::make_pair(_name, _value));
-		else throw std::string("The variable \"") + _name + "\" has been defined twice.";
+		else throw std::string("The variable \"") + std::string(util::symbols().name(_name)) + "\" has been defined twice.";
 	}
 
 	/*
 	 * If no such `_name` exists,
 	 * otherwise if Type-Check fails,throw Env_Ex.
 	 */
-	void Env::update(const lexer::identifier& _name, const value_t& _value)
+	void Env::update(util::symbol_t _name, const value_t& _value)
 	{
 		auto it = _env.find(_name);
 
 		// check wheather exists
 		if (it == _env.end())
-			throw std::string("The variable \"") + _name + "\" has not been defined.";
+			throw std::string("The variable \"") + std::string(util::symbols().name(_name)) + "\" has not been defined.";
 
 		// type check
 		else if (_value.second.index() != it->second.second.index())
-			throw std::string("The type of value assigned to the variable \"") + _name + "\" has not been matched: "
+			throw std::string("The type of value assigned to the variable \"") + std::string(util::symbols().name(_name)) + "\" has not been matched: "
 			+ TEST::outputType(it->second) + " to " + TEST::outputType(_value);
 
 		// type detailed check
@@ -65,7 +65,7 @@ namespace Mini_C::interpret
 	}
 
 	typename Env::Env_ptr Env::make_env(const Env_ptr& cur_env_ptr,
-		const std::vector<std::pair<identifier, value_t>>& param_list)
+		const std::vector<std::pair<util::symbol_t, value_t>>& param_list)
 	{
 		Env_ptr new_env = std::make_shared<Env>(cur_env_ptr);
 		for (auto const&[id, v] : param_list)
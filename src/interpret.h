@@ -6,11 +6,12 @@
 #include <type_traits>
 #include "lexer.h"
 #include "parser.h"
+#include "../util/interner.h"
 
 namespace Mini_C::interpret
 {
 
-	using num_t = std::tuple<double, lexer::numeric_type>;
+	using num_t = std::tuple<lexer::number_value, lexer::numeric_type>;
 	struct pointer_t {};
 	struct str_t {};
 	struct class_t {};
@@ -20,13 +21,13 @@ namespace Mini_C::interpret
 	using value_t = std::pair<specifier_t,
 		std::variant<num_t, pointer_t, str_t, class_t, union_t>>;
 
-	// constraint on variables
+	// constraint on variables, the names are the interned ids of the identifiers
 	class Env
 	{
 		using Env_Ex = std::string;
 		using Env_ptr = std::shared_ptr<Env>;
 
-		std::unordered_map<lexer::identifier, value_t> _env;
+		std::unordered_map<util::symbol_t, value_t> _env;
 		const Env_ptr _prev_env_p;
 
 		template<typename> friend class std::_Ref_count_obj;
@@ -44,21 +45,21 @@ namespace Mini_C::interpret
 		/*
 		* If no such `_name` exists, throw Env_Ex.
 		*/
-		value_t find(const lexer::identifier& _name);
+		value_t find(util::symbol_t _name);
 
 		/*
 		* If such `_name` exists, throw Env_Ex.
 		*/
-		void insert(const lexer::identifier& _name, const value_t& _value);
+		void insert(util::symbol_t _name, const value_t& _value);
 
 		/*
 		* If no such `_name` exists,
 		* otherwise if Type-Check fails,throw Env_Ex.
 		*/
-		void update(const lexer::identifier& _name, const value_t& _value);
+		void update(util::symbol_t _name, const value_t& _value);
 
 		Env_ptr make_env(const Env_ptr& cur_env_ptr,
-			const std::vector<std::pair<lexer::identifier, value_t>>& param_list);
+			const std::vector<std::pair<util::symbol_t, value_t>>& param_list);
 
 	};
 
@@ -7,9 +7,18 @@
 //
 
 #include "lexer.h"
+#include "../util/source_buffer.h"
+#include "../util/char_class.h"
+#include "../util/simd_scan.h"
 #include <vector>
 #include <functional>
 #include <unordered_set>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <charconv>
 
 // As lexical analyzer, I must assume that except for the appearance of some unknown character which is definitely wrong input, the input is all right.
 // the mission of it is to divide them into the right sequence, give each of them the type that as fidelity as possible and the corresponding right value, if it has.
@@ -48,51 +57,44 @@ namespace Mini_C::lexer::analyzers {
 	using analyzer = function<bool(const char *, size_t&, const size_t, vector<token_info> &)>;
 
 	namespace supporters {
-		const static unordered_map<char, char> escapingMap = {
-				{ 't', '\t' }, { 'n', '\n' }, { 'r', '\r' }, { 'a', '\a' }, { 'b', '\b' }, { 'f', '\f' }
-		};
-		const static unordered_set<char> combindableOperatorSet = {
-				'|', '&', '+', '^', '*', '/', '!', '.', ':', '=', '<', '>', '%'
-		};
-		const static unordered_set<char> singleOperatorSet = {
-				'(', ')', '{', '}', '[', ']', ';', ',', '?'
-		};
-		const static unordered_set<char> secondCombinableOperatorSet = {
-				'+', '=', '|', '&', '.', ':', '<', '>'
-		};
-		const static unordered_set<char> dividerCharSet = {
-				' ', '\n', '\t'
-		};
-		const static unordered_set<char> minusCharSet = {
-				'-', '=', '>'
-		};
+		using util::char_is;
+		namespace char_class = util::char_class;
+
+		// the char after '\\', the chars without an entry stand for themselves, like \', \", \\ .
+		constexpr std::array<char, 256> make_escaping_table() {
+			std::array<char, 256> table{};
+			for (std::size_t c = 0; c < 256; c++) table[c] = static_cast<char>(c);
+			table['t'] = '\t'; table['n'] = '\n'; table['r'] = '\r'; table['a'] = '\a'; table['b'] = '\b'; table['f'] = '\f';
+			return table;
+		}
+		constexpr std::array<char, 256> escapingTable = make_escaping_table();
 
 		inline bool inMinusCharSet(char c) {
-			return minusCharSet.find(c) != minusCharSet.end();
+			return c == '-' || c == '=' || c == '>';
 		}
 		inline bool isDivider(char c) {
-			return dividerCharSet.find(c) != dividerCharSet.end();
+			return char_is(c, char_class::divider);
 		}
 		inline bool isWordBeginning(char c) {
-			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+			return char_is(c, char_class::word_begin);
 		}
 		inline bool isNum(char c) {
-			return c >= '0' && c <= '9';
+			return char_is(c, char_class::digit);
 		}
 		inline bool isNumBegin(char c) {
 			return isNum(c) || c == '.';
 		}
 		inline bool canInWord(char c) {
-			return isWordBeginning(c) || isNum(c);
+			return char_is(c, char_class::word);
 		}
 		inline bool isCombindableOperatorChar(char c) {
-			return combindableOperatorSet.find(c) != combindableOperatorSet.end();
+			return char_is(c, char_class::operator_char);
 		}
 		inline bool isSingleSymbolChar(char c) {
-			return singleOperatorSet.find(c) != singleOperatorSet.end();
+			return char_is(c, char_class::single_symbol);
 		}
 		inline bool isSecondCombinableOpearatorChar(char c) {
-			return secondCombinableOperatorSet.find(c) != secondCombinableOperatorSet.end();
+			return char_is(c, char_class::operator_next);
 		}
 		inline bool isOctNum(char c) {
 			return c >= '0' && c <= '7';
@@ -118,7 +120,7 @@ namespace Mini_C::lexer::analyzers {
 			}, rb);
 		}
 		inline bool isHex(char c) {
-			return isNum(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+			return char_is(c, char_class::hex);
 		}
 		inline int turnHex(char c) {
 			if (isNum(c))
@@ -131,15 +133,13 @@ namespace Mini_C::lexer::analyzers {
 
 		// unnecessity
 		// follow numbers
-		const static unordered_set<char> followNumberCharSet = { '+', '-', '*', '/', ')', ']', '}', '|', '&', '^', ',', ':', ';', '%', '=', '>', '<' };
 		inline bool canFollowNumber(char c) {
-			return followNumberCharSet.find(c) != followNumberCharSet.end();
+			return char_is(c, char_class::follow_number);
 		}
 
 		// for calculator
-		const static unordered_set<char> calculatorNormalOperatorCharSet = { '+', '*', '/', '|', '&', '^', '~', '(', ')', '%' };
 		inline bool isInCalculatorNormalOperatorCharSet(char c) {
-			return calculatorNormalOperatorCharSet.find(c) != calculatorNormalOperatorCharSet.end();
+			return std::string_view("+*/|&^~()%").find(c) != std::string_view::npos;
 		}
 		// end for calculator
 	}
@@ -157,9 +157,9 @@ namespace Mini_C::lexer::analyzers {
 		keyword_it it = keywords.find(ns);
 		if (it != keywords.end())
 			if (it->second == type::TRUE)
-				r.push_back(make_tuple((std::tuple<const double, const numeric_type>(1.0, numeric_type::BOOLEAN)), pos));
+				r.push_back(make_tuple(numeric_t(number_value{ true }, numeric_type::BOOLEAN), pos));
 			else if (it->second == type::FALSE)
-				r.push_back(make_tuple((std::tuple<const double, const numeric_type>(0.0, numeric_type::BOOLEAN)), pos));
+				r.push_back(make_tuple(numeric_t(number_value{ false }, numeric_type::BOOLEAN), pos));
 			else
 				r.push_back(make_tuple((it->second), pos));
 		else
@@ -193,6 +193,19 @@ namespace Mini_C::lexer::analyzers {
 		return true;
 	}
 
+	// "//" to the end of the line, a block comment which is not closed on the line ends with it
+	write_analyzer(comment_analyzer) {
+		if (s[pos] != '/' || (s[pos + 1] != '/' && s[pos + 1] != '*'))
+			return false;
+		if (s[pos + 1] == '/') {
+			pos = size;
+			return true;
+		}
+		const size_t end = util::simd::find_comment_end(s, pos + 2, size);
+		pos = end == size ? size : end + 2;
+		return true;
+	}
+
 	write_analyzer(single_symbol_analyzer) {
 		if (!supporters::isSingleSymbolChar(s[pos]))
 			return false;
@@ -229,11 +242,7 @@ namespace Mini_C::lexer::analyzers {
 
 		auto charTackle = [&]() {
 			char c = s[pos++]; // no need to point to next in the following
-			unordered_map<char, char>::const_iterator p = supporters::escapingMap.find(c);
-			if (p != supporters::escapingMap.end())
-				value = p->second;
-			else // like \', \", \\ that's just the same with '\c' which means 'c' itself
-				value = c;
+			value = supporters::escapingTable[static_cast<unsigned char>(c)];
 			// here pos is in next char to check
 		};
 
@@ -252,24 +261,29 @@ namespace Mini_C::lexer::analyzers {
 		// here pos is in next char to check
 	}
 
-	write_analyzer(char_analyzer) {
-		if (s[pos] != '\'')
-			return false;
-
+	// here pos is in the first '\'', return the error as `number_literal()`
+	const char* char_literal(const char *s, size_t& pos, const size_t size, vector<token_info> &r) {
 		if (++pos == size)
-			throw Token_Ex("expected corresponding \'", pos);
-		if (s[pos] == '\\')
-			r.push_back(make_tuple((std::tuple<const double, const numeric_type>((double)escapeTackle(s, pos, size, r), numeric_type::CHAR)), pos));
-		else
-			r.push_back(make_tuple((std::tuple<const double, const numeric_type>((double)s[pos++], numeric_type::CHAR)), pos));
+			return "expected corresponding \'";
+		const char value = s[pos] == '\\' ? static_cast<char>(escapeTackle(s, pos, size, r)) : s[pos++];
+		const size_t at = pos;
 
-		if (s[pos++] != '\'')
-			throw Token_Ex("there should be only one character in \'\'", pos);
+		if (pos > size || s[pos++] != '\'') // past `size` after a '\\' at the end
+			return "there should be only one character in \'\'";
 
 		//        if (pos + 1 >= size || s[pos + 1] != '\'')
 		//            throw Token_Ex("there should be only one character in \'\'", pos);
 		//        pos += 2;
 
+		r.push_back(make_tuple(numeric_t(number_value{ value }, numeric_type::CHAR), at));
+		return nullptr;
+	}
+
+	write_analyzer(char_analyzer) {
+		if (s[pos] != '\'')
+			return false;
+		if (const char* error = char_literal(s, pos, size, r))
+			throw Token_Ex(error, pos);
 		return true;
 	}
 
@@ -285,8 +299,8 @@ namespace Mini_C::lexer::analyzers {
 			else
 				ns += s[pos++]; // also next char to check
 
-		if (pos == size)
-			throw Token_Ex("expected a corresponding '\"'", pos);
+		if (pos >= size) // `pos` is past `size` after a '\\' at the end
+			throw Token_Ex("expected a corresponding '\"'", size);
 
 		r.push_back(make_tuple((make_tuple(std::move(ns))), pos));
 
@@ -295,107 +309,96 @@ namespace Mini_C::lexer::analyzers {
 		return true;
 	}
 
-	// only get the number, but can be specified to accept the condition that tells whether it's minus
-	bool inner_number_analyzer(const char *s, size_t &pos, const size_t size, vector<token_info> &r, const bool isMinus = false) {
-
-		auto generateNumberException = [&]() {
-			throw Token_Ex("not a valid number", pos);
+	/*
+	 * only get the number, but can be specified to accept the condition that tells whether it's minus.
+	 * no exception: return the error, then `pos` is where it is, or nullptr.
+	 */
+	const char* number_literal(const char *s, size_t &pos, const size_t size, vector<token_info> &r, const bool isMinus) {
+		constexpr const char* not_a_number = "not a valid number";
+
+		// the digits without '_' are parsed by `std::from_chars`, so the value is exact, or correctly rounded for f32 and f64
+		std::string digits;
+		auto parse = [&](auto value, numeric_type type, auto... format) -> const char* {
+			const auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), value, format...);
+			if (ec == std::errc::result_out_of_range)
+				return "number out of range";
+			if (ec != std::errc() || end != digits.data() + digits.size())
+				return not_a_number;
+			r.push_back(make_tuple(numeric_t(number_value{ value }, type), pos));
+			return nullptr;
 		};
 
-		auto hexAnalyzer = [&]() {
+		auto hexAnalyzer = [&]() -> const char* {
 			pos += 2;
 			if (isMinus || !supporters::isHex(s[pos]))
-				generateNumberException();
+				return not_a_number;
 
-			double value = supporters::turnHex(s[pos]);
+			digits += s[pos];
 			while (true)
 				if (supporters::isHex(s[++pos]))
-					value = value * 16 + supporters::turnHex(s[pos]);
+					digits += s[pos];
 				else if (s[pos] == '_')
 					continue;
 				else
 					break;
 
-			// unnecessity
-			// check if it's followed by '.' to generate things.
-			//            while (supporters::isDivider(s[pos])) ++pos;
-			//            char c = s[pos];
-			//            if (c == '.')
-			//                generateNumberException();
-
-			r.push_back(make_tuple((std::tuple<const double, const numeric_type>(value, numeric_type::U32)), pos));
+			return parse(std::uint32_t{}, numeric_type::U32, 16);
 		};
 
-		auto defaultAnalyzer = [&]() {
-			double value = 0;
-			numeric_type type = numeric_type::I32;
+		auto defaultAnalyzer = [&]() -> const char* {
+			if (isMinus) digits += '-';
 
-			auto decimalAnalyzer = [&]() {
-				// here pos is where '.'/'e'/'E' appears
-				int decimal = 0;
-				type = numeric_type::F32;
+			auto decimalAnalyzer = [&]() -> const char* {
+				// here pos is where '.'/'e'/'E' appears, "." and "-." alone are 0 as before
+				bool dot = false;
+				if (digits.empty() || digits == "-")
+					digits += '0';
 
-				auto f64Analyzer = [&]() {
+				auto f64Analyzer = [&]() -> const char* {
 					// here pos is where e/E appears
-					++pos;
-					bool rminus = false;
-					if (s[pos] == '-') {
-						rminus = true;
-						++pos;
-					}
+					digits += 'e';
+					if (s[++pos] == '-')
+						digits += s[pos++];
 					// for '\0' is definitely not num, no need to check the boundary
 					if (!supporters::isNum(s[pos]))
-						generateNumberException();
-
-					// previous(wrong) implemetation
-					//                    if (s[pos] != '-' && !supporters::isNum(s[pos]))
-					//                        generateNumberException();
-					//
-					//                    int right = 0;
-					//                    bool rminus = false;
-					//                    if (s[pos] == '-') {
-					//                        rminus = true;
-					//                        ++pos;
-					//                    }
-
-					int right = (s[pos] - '0');
-					type = numeric_type::F64;
+						return not_a_number;
 
+					digits += s[pos];
 					while (true)
 						if (supporters::isNum(s[++pos]))
-							right = right * 10 + (s[pos] - '0');
+							digits += s[pos];
 						else if (s[pos] == '_')
 							continue;
 						else
 							break;
 
-					r.push_back(make_tuple((std::tuple<const double, const numeric_type>((isMinus ? -value : value) * pow(10, rminus ? -right : right), type)), pos));
+					return parse(double{}, numeric_type::F64, std::chars_format::general);
 				};
 
 				//default is f32 analyzer
 				for (; true; ++pos) {
 					char c = s[pos];
 					if (supporters::isNum(c))
-						value += (c - '0') * pow(10, decimal--);
+						digits += c;
 					else if (c == '_')
 						if (s[pos - 1] == '.')
-							throw Token_Ex("'.' can't be followed by '_'", pos);
+							return "'.' can't be followed by '_'";
 						else
 							continue;
 					else if (c == '.')
-						if (!decimal)
-							--decimal;
+						if (!dot) {
+							dot = true;
+							digits += c;
+						}
 						else
-							generateNumberException();
-					else if (c == 'e' || c == 'E') {
-						f64Analyzer();
-						return;
-					}
+							return not_a_number;
+					else if (c == 'e' || c == 'E')
+						return f64Analyzer();
 					else
 						break;
 				}
 
-				r.push_back(make_tuple((std::tuple<const double, const numeric_type>((isMinus ? -value : value), type)), pos));
+				return parse(float{}, numeric_type::F32, std::chars_format::general);
 			};
 
 
@@ -403,39 +406,41 @@ namespace Mini_C::lexer::analyzers {
 			for (; true; ++pos) {
 				char c = s[pos];
 				if (supporters::isNum(c))
-					value = value * 10 + (c - '0');
+					digits += c;
 				else if (c == '_')
 					continue;
-				else if (c == '.' || c == 'e' || c == 'E') {
-					decimalAnalyzer();
-					return;
-				}
+				else if (c == '.' || c == 'e' || c == 'E')
+					return decimalAnalyzer();
 				else if (c == 'u' || c == 'U') {
 					if (isMinus)
-						generateNumberException();
+						return not_a_number;
 					++pos;
-					type = numeric_type::U32;
-					break;
+					return parse(std::uint32_t{}, numeric_type::U32, 10);
 				}
 				else
 					break;
 			}
 
-			r.push_back(make_tuple((std::tuple<const double, const numeric_type>((isMinus ? -value : value), type)), pos));
+			return parse(std::int32_t{}, numeric_type::I32, 10);
 		};
 
 
-		if (s[pos] == '0' && pos + 1 < size && s[pos + 1] == 'x')
-			hexAnalyzer();
-		else
-			defaultAnalyzer();
+		const char* error = s[pos] == '0' && pos + 1 < size && s[pos + 1] == 'x' ? hexAnalyzer() : defaultAnalyzer();
+		if (error != nullptr)
+			return error;
 
 		// unneccesity
 		// see if the following char is allowed
 		while (supporters::isDivider(s[pos])) ++pos;
 		if (pos < size && !supporters::canFollowNumber(s[pos]))
-			throw Token_Ex("not valid following content", pos);
+			return "not valid following content";
 
+		return nullptr;
+	}
+
+	bool inner_number_analyzer(const char *s, size_t &pos, const size_t size, vector<token_info> &r, const bool isMinus = false) {
+		if (const char* error = number_literal(s, pos, size, r, isMinus))
+			throw Token_Ex(error, pos);
 		return true;
 	}
 
@@ -507,8 +512,9 @@ analyzers::analyzer analyzer[] = {
 	analyzers::calculator_analyzer,
 };
 #else
-constexpr int analyzerNum = 7; //7 in normal, 1 in calculator
+constexpr int analyzerNum = 8; //8 in normal, 1 in calculator
 analyzers::analyzer analyzer[] = {
+		analyzers::comment_analyzer,
 		analyzers::word_analyzer,
 		analyzers::number_analyzer,
 		analyzers::minus_analyzer,
@@ -520,13 +526,269 @@ analyzers::analyzer analyzer[] = {
 #endif
 
 
+/**
+ * table-driven scanner, gives the same tokens as the analyzer chain:
+ *     the first char of a token is dispatched by one table lookup,
+ *     operators are matched by a DFA generated from `operators`, the longest match wins.
+ */
+namespace Mini_C::lexer::dfa {
+
+	enum class action : std::uint8_t {
+		invalid, divider, word, number, dot, minus, single, op, slash, character, string,
+	};
+
+	constexpr std::array<action, 256> make_actions() {
+		namespace char_class = util::char_class;
+		std::array<action, 256> actions{};
+		for (std::size_t c = 0; c < 256; c++) {
+			const std::uint8_t flags = util::char_classes[c];
+			actions[c] = flags & char_class::divider ? action::divider
+				: flags & char_class::word_begin ? action::word
+				: flags & char_class::digit ? action::number
+				: flags & char_class::single_symbol ? action::single
+				: flags & char_class::operator_char ? action::op
+				: action::invalid;
+		}
+		actions['.'] = action::dot; // number if a digit follows, else operator
+		actions['-'] = action::minus;
+		actions['/'] = action::slash; // a comment, or an operator
+		actions['\''] = action::character;
+		actions['"'] = action::string;
+		return actions;
+	}
+	constexpr std::array<action, 256> actions = make_actions();
+
+	constexpr std::array<type, 256> make_singles() {
+		std::array<type, 256> singles{};
+		singles['('] = type::LEFT_PARENTHESIS;     singles[')'] = type::RIGHT_PARENTHESIS;
+		singles['{'] = type::LEFT_CURLY_BRACKETS;  singles['}'] = type::RIGHT_CURLY_BRACKETS;
+		singles['['] = type::LEFT_SQUARE_BRACKETS; singles[']'] = type::RIGHT_SQUARE_BRACKETS;
+		singles[';'] = type::SEMICOLON; singles[','] = type::COMMA; singles['?'] = type::QUESTION;
+		return singles;
+	}
+	constexpr std::array<type, 256> singles = make_singles();
+
+	// the operators starting with `action::op` and `action::dot`, "-" is done by `minus()`
+	constexpr keyword_t operators[] = {
+		{ "+", type::ADD }, { "*", type::MUL }, { "/", type::DIV }, { "%", type::MOD },
+		{ "<<", type::LEFT_SHIFT }, { ">>", type::RIGHT_SHIFT },
+		{ "&", type::AND }, { "|", type::OR }, { "^", type::XOR }, { "++", type::SELF_INC },
+		{ "!", type::LOGIC_NOT }, { "&&", type::LOGIC_AND }, { "||", type::LOGIC_OR },
+		{ "==", type::EQ }, { "!=", type::NEQ }, { "<", type::LESS }, { ">", type::GREATER }, { "<=", type::LEQ }, { ">=", type::GEQ },
+		{ "=", type::ASSIGN }, { "+=", type::ADD_EQ }, { "*=", type::MUL_EQ }, { "/=", type::DIV_EQ }, { "%=", type::MOD_EQ },
+		{ "<<=", type::L_SHIFT_EQ }, { ">>=", type::R_SHIFT_EQ }, { "&=", type::AND_EQ }, { "|=", type::OR_EQ }, { "^=", type::XOR_EQ },
+		{ ".", type::PERIOD }, { ":", type::COLON }, { "::", type::CLASS_SCOPE },
+	};
+
+	/*
+	 * trie of `operators`, state 0 is the start, `_next` is 0 if there is no transition.
+	 * every prefix of an operator is an operator, so the state where the walk stops accepts.
+	 */
+	constexpr std::size_t op_columns = 16, op_states = 48;
+	struct op_dfa_t {
+		std::uint8_t _column[256]{};                // char -> column, 0 for the chars in no operator
+		std::uint8_t _next[op_states][op_columns]{};
+		type _accept[op_states]{};
+		bool _accepting[op_states]{};
+		std::size_t _columns = 1, _states = 1;
+	};
+
+	constexpr op_dfa_t make_op_dfa() {
+		op_dfa_t dfa{};
+		for (const keyword_t& op : operators) {
+			std::size_t state = 0;
+			for (const char c : op._text) {
+				std::uint8_t& column = dfa._column[static_cast<unsigned char>(c)];
+				if (column == 0) column = static_cast<std::uint8_t>(dfa._columns++);
+				std::uint8_t& next = dfa._next[state][column];
+				if (next == 0) next = static_cast<std::uint8_t>(dfa._states++);
+				state = next;
+			}
+			dfa._accept[state] = op._type;
+			dfa._accepting[state] = true;
+		}
+		return dfa;
+	}
+	constexpr op_dfa_t op_dfa = make_op_dfa();
+
+	constexpr bool op_dfa_is_valid() {
+		if (op_dfa._columns > op_columns || op_dfa._states > op_states) return false;
+		for (std::size_t state = 1; state < op_dfa._states; state++)
+			if (!op_dfa._accepting[state]) return false;
+		return true;
+	}
+	static_assert(op_dfa_is_valid(), "too many operators, or an operator whose prefix is not an operator");
+
+	// the last token ends an operand, so "-" is binary
+	inline bool unminusable(const vector<token_info>& r) {
+		if (r.empty()) return false;
+		const token_t& token = std::get<token_t>(r.back());
+		if (token.index() != 0) return token.index() != 3; // identifier, number, but not string
+		switch (std::get<type>(token)) {
+		case type::SELF_INC: case type::SELF_DEC:
+		case type::RIGHT_PARENTHESIS: case type::RIGHT_SQUARE_BRACKETS: case type::RIGHT_CURLY_BRACKETS:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	constexpr bool is_listed(const keyword_t& op) {
+		for (const keyword_t& keyword : keyword_list)
+			if (keyword._text == op._text) return keyword._type == op._type;
+		return false;
+	}
+
+	constexpr bool operators_are_listed() {
+		for (const keyword_t& op : operators)
+			if (!is_listed(op)) return false;
+		return true;
+	}
+	static_assert(operators_are_listed(), "an operator differs from `keyword_list`");
+
+	constexpr bool is_word(std::string_view text) {
+		if (!util::char_is(text[0], util::char_class::word_begin)) return false;
+		for (const char c : text)
+			if (!util::char_is(c, util::char_class::word)) return false;
+		return true;
+	}
+
+	constexpr std::size_t count_word_keywords() {
+		std::size_t count = 0;
+		for (const keyword_t& keyword : keyword_list)
+			count += is_word(keyword._text);
+		return count;
+	}
+
+	// the keywords made of word chars, taken from `keyword_list`
+	constexpr std::array<keyword_t, count_word_keywords()> make_word_keywords() {
+		std::array<keyword_t, count_word_keywords()> words{};
+		std::size_t count = 0;
+		for (const keyword_t& keyword : keyword_list)
+			if (is_word(keyword._text)) words[count++] = keyword;
+		return words;
+	}
+	constexpr std::array<keyword_t, count_word_keywords()> word_keywords = make_word_keywords();
+
+	/*
+	 * perfect hash of `word_keywords`: no two keywords share a slot,
+	 * so a word is a keyword iff it equals the one keyword in its slot.
+	 * the words of 1 char or longer than 12 chars are no keywords, the others have a 2nd char.
+	 */
+	constexpr std::size_t keyword_slots = 128, min_keyword_size = 2, max_keyword_size = 12;
+	constexpr std::size_t keyword_hash(std::string_view word) {
+		return (word.size() + 3 * static_cast<unsigned char>(word[0]) + 2 * static_cast<unsigned char>(word[1])
+			+ 13 * static_cast<unsigned char>(word.back())) % keyword_slots;
+	}
+
+	constexpr std::array<keyword_t, keyword_slots> make_keyword_table() {
+		std::array<keyword_t, keyword_slots> table{};
+		for (const keyword_t& keyword : word_keywords)
+			table[keyword_hash(keyword._text)] = keyword;
+		return table;
+	}
+	constexpr std::array<keyword_t, keyword_slots> keyword_table = make_keyword_table();
+
+	constexpr bool keyword_table_is_perfect() {
+		for (const keyword_t& keyword : word_keywords)
+			if (keyword._text.size() < min_keyword_size || keyword._text.size() > max_keyword_size
+				|| keyword_table[keyword_hash(keyword._text)]._text != keyword._text)
+				return false;
+		return true;
+	}
+	static_assert(keyword_table_is_perfect(), "two keywords share a slot, change `keyword_hash`");
+
+	inline const keyword_t* find_keyword(std::string_view word) {
+		if (word.size() < min_keyword_size || word.size() > max_keyword_size) return nullptr;
+		const keyword_t& keyword = keyword_table[keyword_hash(word)];
+		return keyword._text == word ? &keyword : nullptr;
+	}
+
+	// a name is interned from the text if there are `names`, otherwise copied into a string
+	void word(const char* s, size_t& pos, const size_t size, vector<token_info>& r, name_sink_t* names) {
+		const size_t length = util::simd::skip_word(s, pos + 1, size) - pos;
+		const std::string_view name(s + pos, length);
+
+		const keyword_t* keyword = find_keyword(name);
+		if (keyword == nullptr && names != nullptr) {
+			names->_symbols.push_back(names->_names->intern(name));
+			r.emplace_back(string(), pos);
+		}
+		else if (keyword == nullptr)
+			r.emplace_back(string(name), pos);
+		else if (keyword->_type == type::TRUE)
+			r.emplace_back(numeric_t(number_value{ true }, numeric_type::BOOLEAN), pos);
+		else if (keyword->_type == type::FALSE)
+			r.emplace_back(numeric_t(number_value{ false }, numeric_type::BOOLEAN), pos);
+		else
+			r.emplace_back(keyword->_type, pos);
+		pos += length;
+	}
+
+	void op(const char* s, size_t& pos, vector<token_info>& r) {
+		std::size_t state = 0;
+		while (const std::uint8_t next = op_dfa._next[state][op_dfa._column[static_cast<unsigned char>(s[pos])]]) {
+			state = next;
+			++pos;
+		}
+		r.emplace_back(op_dfa._accept[state], pos);
+	}
+
+	// "-", "--", "-=", "->", or the sign of a number, as `minus_analyzer` does
+	const char* minus(const char* s, size_t& pos, const size_t size, vector<token_info>& r) {
+		const size_t begin = pos;
+		pos = util::simd::skip_dividers(s, pos + 1, size);
+		if (analyzers::supporters::isNumBegin(s[pos]) && !unminusable(r))
+			return analyzers::number_literal(s, pos, size, r, true);
+		if (begin != pos - 1 || pos == size || (s[pos] != '-' && s[pos] != '=' && s[pos] != '>')) {
+			r.emplace_back(type::SUB, pos);
+			return nullptr;
+		}
+		r.emplace_back(s[pos] == '-' ? type::SELF_DEC : s[pos] == '=' ? type::SUB_EQ : type::MEMBER_ACCESS, pos);
+		++pos;
+		return nullptr;
+	}
+
+	// `pos` is after "/*", then after "*/", or at `size` with `in_comment` set if the comment goes on in the next line
+	inline void block_comment(const char* s, size_t& pos, const size_t size, bool& in_comment) {
+		pos = util::simd::find_comment_end(s, pos, size);
+		in_comment = pos == size;
+		if (!in_comment)
+			pos += 2;
+	}
+
+	// the text between escapes is copied at once
+	const char* string_literal(const char* s, size_t& pos, const size_t size, vector<token_info>& r) {
+		string ns;
+		for (++pos; ; ) {
+			const size_t stop = util::simd::find_string_stop(s, pos, size);
+			ns.append(s + pos, stop - pos);
+			pos = stop;
+			if (pos >= size || s[pos] == '"')
+				break;
+			ns += (char)analyzers::escapeTackle(s, pos, size, r); // may go past `size` after a '\\' at the end
+		}
+
+		if (pos >= size) {
+			pos = size;
+			return "expected a corresponding '\"'";
+		}
+
+		r.emplace_back(string_literal_t(std::move(ns)), pos);
+		++pos;
+		return nullptr;
+	}
+
+} // end namespace Mini_C::lexer::dfa
+
+
 // for Lexer::print()
 namespace Mini_C::TEST { void num_print(const lexer::numeric_t& _num, std::ostream&); }
 
 
 namespace Mini_C::lexer
 {
-	std::variant<std::vector<token_info>, analyzers::Token_Ex> tokenize(const char *s, const size_t size) noexcept {
+	std::variant<std::vector<token_info>, analyzers::Token_Ex> tokenize_by_analyzers(const char *s, const size_t size) noexcept {
 		vector<token_info> r;
 		bool ok;
 		for (size_t pos = 0; pos < size; ) {
@@ -543,8 +805,9 @@ namespace Mini_C::lexer
 						break;
 				}
 				catch (analyzers::Token_Ex& e) {
+					const size_t at = std::min(e._position, size); // as the scanner reports it
 					return analyzers::Token_Ex(
-						e._msg + "\"" + s[e._position] + "\"", e._position
+						e._msg + "\"" + s[at] + "\"", at
 					);
 				}
 			}
@@ -555,96 +818,822 @@ namespace Mini_C::lexer
 		}
 
 		return r;
+	} // end fuction tokenize_by_analyzers();
+
+
+	/*
+	 * the analyzers of the scanner return their errors, so nothing is thrown and unwound,
+	 * even for a malformed line with many errors.
+	 */
+	std::vector<analyzers::Token_Ex> tokenize(const char *s, const size_t size, vector<token_info> &r, const bool recover, bool& in_comment,
+		name_sink_t* names) noexcept {
+		std::vector<analyzers::Token_Ex> errors;
+		size_t pos = 0;
+		if (in_comment)
+			dfa::block_comment(s, pos, size, in_comment);
+		while (pos < size) {
+			const char c = s[pos];
+			const char* error = nullptr;
+			switch (dfa::actions[static_cast<unsigned char>(c)]) {
+			case dfa::action::divider:
+				pos = util::simd::skip_dividers(s, pos + 1, size);
+				break;
+			case dfa::action::word:
+				dfa::word(s, pos, size, r, names);
+				break;
+			case dfa::action::dot:
+				if (!analyzers::supporters::isNum(s[pos + 1])) {
+					dfa::op(s, pos, r);
+					break;
+				}
+				[[fallthrough]];
+			case dfa::action::number:
+				error = analyzers::number_literal(s, pos, size, r, false);
+				break;
+			case dfa::action::minus:
+				error = dfa::minus(s, pos, size, r);
+				break;
+			case dfa::action::single:
+				r.emplace_back(dfa::singles[static_cast<unsigned char>(c)], ++pos);
+				break;
+			case dfa::action::op:
+				dfa::op(s, pos, r);
+				break;
+			case dfa::action::slash:
+				if (s[pos + 1] == '/')
+					pos = size; // the comment bytes are not even looked at
+				else if (s[pos + 1] == '*')
+					dfa::block_comment(s, pos += 2, size, in_comment);
+				else
+					dfa::op(s, pos, r);
+				break;
+			case dfa::action::character:
+				error = analyzers::char_literal(s, pos, size, r);
+				break;
+			case dfa::action::string:
+				error = dfa::string_literal(s, pos, size, r);
+				break;
+			default:
+				error = "not a recognizable character.";
+			}
+			if (error == nullptr)
+				continue;
+
+			pos = std::min(pos, size);
+			errors.emplace_back(std::string(error) + "\"" + s[pos] + "\"", pos);
+			if (!recover)
+				break;
+			r.emplace_back(type::ERROR, pos);
+			++pos;
+		}
+		return errors;
+	} // end fuction tokenize();
+
+
+#ifdef TEST_CALC
+	std::variant<std::vector<token_info>, analyzers::Token_Ex> tokenize(const char *s, const size_t size) noexcept {
+		return tokenize_by_analyzers(s, size);
+	}
+#else
+	std::variant<std::vector<token_info>, analyzers::Token_Ex> tokenize(const char *s, const size_t size) noexcept {
+		vector<token_info> r;
+		bool in_comment = false;
+		std::vector<analyzers::Token_Ex> errors = tokenize(s, size, r, false, in_comment);
+		if (!errors.empty())
+			return std::move(errors.front());
+		return r;
 	} // end fuction tokenize();
+#endif
+
+
+	namespace
+	{
+		// the tokens of a line, each `ERROR` token takes the next error as its diagnostic, each empty `identifier` the next symbol
+		void push_line(TokenStream& stream, std::vector<Lexer::Diagnostic>& diagnostics,
+			const std::vector<token_info>& tokens, std::vector<analyzers::Token_Ex>& errors, const name_sink_t& names, std::size_t offset)
+		{
+			std::size_t error = 0, name = 0;
+			for (token_info const& token : tokens)
+			{
+				const identifier* interned = std::get_if<identifier>(&std::get<token_t>(token));
+				if (interned != nullptr && interned->empty())
+				{
+					stream.push(token, static_cast<std::uint32_t>(offset), names._symbols[name++]);
+					continue;
+				}
+				const type* kind = std::get_if<type>(&std::get<token_t>(token));
+				if (kind == nullptr || *kind != type::ERROR)
+				{
+					stream.push(token, static_cast<std::uint32_t>(offset));
+					continue;
+				}
+				stream.push(token, static_cast<std::uint32_t>(offset), static_cast<std::uint32_t>(diagnostics.size()));
+				diagnostics.push_back(Lexer::Diagnostic{ std::move(errors[error]._msg),
+					SourceLoc{ static_cast<std::uint32_t>(offset + errors[error]._position) } });
+				error++;
+			}
+		}
+
+		// lines lexed apart from the `Lexer`, then moved into it
+		struct lexed_lines_t
+		{
+			TokenStream _tokens;
+			std::vector<std::uint32_t> _line_starts;
+			std::vector<std::uint32_t> _comment_lines;     // starts of the lines which begin in a block comment
+			std::vector<Lexer::Diagnostic> _diagnostics;
+			analyzers::Token_Ex _error{ std::string{}, 0 };
+			bool _in_comment = false;                      // at the first line, then after the last one
+			name_sink_t _names;                            // the symbols of the line lexed last
+
+			explicit lexed_lines_t(util::Interner& names) :_tokens(names), _names{ &names, {} } {}
+		};
+
+		/*
+		 * the lines which start in `[begin, end)` of the text, cut as `tokenize()` does,
+		 * a file drops the '\r' of "\r\n" as `SourceBuffer::lines()` does.
+		 * false at the first error, unless `recover`.
+		 */
+		bool lex_lines(const char* text, std::size_t size, std::size_t begin, std::size_t end, bool strip_cr, bool recover, lexed_lines_t& lines)
+		{
+			while (begin < end)
+			{
+				const char* eol = static_cast<const char*>(std::memchr(text + begin, '\n', size - begin));
+				const std::size_t line_end = eol ? eol - text : size;
+				std::size_t line_size = line_end - begin;
+				if (strip_cr && line_size > 0 && text[begin + line_size - 1] == '\r') line_size--;
+				lines._line_starts.push_back(static_cast<std::uint32_t>(begin));
+				if (lines._in_comment) lines._comment_lines.push_back(static_cast<std::uint32_t>(begin));
+				std::vector<token_info> tokens;
+				lines._names._symbols.clear();
+				std::vector<analyzers::Token_Ex> errors = Mini_C::lexer::tokenize(text + begin, line_size, tokens, recover, lines._in_comment, &lines._names);
+				if (!recover && !errors.empty())
+				{
+					lines._error = std::move(errors.front());
+					return false;
+				}
+				push_line(lines._tokens, lines._diagnostics, tokens, errors, lines._names, begin);
+				begin = line_end + 1;
+			}
+			return true;
+		}
+
+		// throws at the first byte of `text[begin, end)` which is no valid UTF-8, `begin` starts the line `line`
+		void check_utf8(const char* text, std::size_t begin, std::size_t end, std::size_t line)
+		{
+			const std::size_t bad = begin + util::simd::find_invalid_utf8(text + begin, end - begin);
+			if (bad == end) return;
+			std::size_t line_start = begin;
+			for (const char* eol; (eol = static_cast<const char*>(std::memchr(text + line_start, '\n', bad - line_start))) != nullptr; line++)
+				line_start = eol - text + 1;
+			throw MiniC_Universal_Exception{ "invalid UTF-8", line, bad - line_start };
+		}
+
+		// `to[first, last)` becomes `from`, the elements after are moved once
+		template<typename T>
+		void replace_range(std::vector<T>& to, std::size_t first, std::size_t last, std::vector<T>& from)
+		{
+			const std::size_t common = std::min(last - first, from.size());
+			std::move(from.begin(), from.begin() + common, to.begin() + first);
+			if (common < from.size())
+				to.insert(to.begin() + first + common, std::make_move_iterator(from.begin() + common), std::make_move_iterator(from.end()));
+			else to.erase(to.begin() + first + common, to.begin() + last);
+		}
+	} // end anonymous namespace
 
 
 	/*
 	 * class member function for Lexer.
 	 */
+	Lexer::Lexer() :_own_names(std::make_unique<util::Interner>()), _names(_own_names.get()), _token_stream(*_names) {}
+
+	Lexer::Lexer(util::Interner& names) :_names(&names), _token_stream(names) {}
+
+	void Lexer::reset()
+	{
+		if (_own_names)
+		{
+			_own_names = std::make_unique<util::Interner>();
+			_names = _own_names.get();
+			_names_built = 0;
+		}
+		_token_stream = TokenStream{ *_names };
+		_front = 0;
+		_line_starts.clear();
+		_lines_lexed = 0;
+		_source_map = preprocess::ExpandedSource{};
+		_map = &_source_map;
+		_streaming = false;
+		_stream_file.close();
+		_text = nullptr;
+		_text_size = 0;
+		_next_line = 0;
+		_diagnostics.clear();
+		_editing = false;
+		_edit_text.clear();
+		_comment_lines.clear();
+		_in_comment = false;
+	}
+
 	void Lexer::tokenize(const std::string filename)
 	{
-		constexpr std::size_t MAXSIZE = 256;
-		char buffer[MAXSIZE];
-		std::ifstream inputFile{ filename, std::ios::in };
-		if (!inputFile.is_open())
+		util::SourceBuffer source;
+		if (!source.open(filename))
 		{
 			std::cout << "failed to open: " << std::quoted(filename) << std::endl;
 			return;
 		}
-		//try {
+		if (source.size() > UINT32_MAX)
+			throw MiniC_Universal_Exception{ "The file is too large", 0, 0 };
+		check_utf8(source.data(), 0, source.size(), 1);
 		std::size_t line_num = 0;
-		_token_stream.clear();
-		while (!inputFile.eof())
+		reset();
+		_source_map._files.push_back(filename);
+		for (std::string_view line : source.lines())
+		{
+			_source_map._lines.push_back(++line_num);
+			tokenize_line(line.data(), line.size(), line_num, line.data() - source.data());
+		}
+	}
+
+	void Lexer::tokenize(const preprocess::ExpandedSource& source)
+	{
+		// `_text` is contiguous and ends with '\0', so every line is followed
+		// by '\n' or '\0', just like the line read into buffer.
+		const char* const text = source._text.c_str();
+		const std::size_t size = source._text.size();
+		if (size > UINT32_MAX)
+			throw MiniC_Universal_Exception{ "The program is too large", 0, 0 };
+		reset();
+		_source_map._lines = source._lines;
+		_source_map._files = source._files;
+		_source_map._file_ranges = source._file_ranges;
+		_source_map._expansions = source._expansions;
+		for (std::size_t begin = 0, index = 0; begin <= size; index++)
+		{
+			const char* eol = static_cast<const char*>(std::memchr(text + begin, '\n', size - begin));
+			const std::size_t end = eol ? eol - text : size;
+			tokenize_line(text + begin, end - begin, source._lines[index], begin);
+			begin = end + 1;
+		}
+	}
+
+	void Lexer::tokenize(const std::string filename, std::size_t threads)
+	{
+		reset();
+		util::SourceBuffer source;
+		if (!source.open(filename))
+		{
+			std::cout << "failed to open: " << std::quoted(filename) << std::endl;
+			return;
+		}
+		if (source.size() > UINT32_MAX)
+			throw MiniC_Universal_Exception{ "The file is too large", 0, 0 };
+		check_utf8(source.data(), 0, source.size(), 1);
+		_source_map._files.push_back(filename); // no `_lines`, the i-th line is line i + 1
+		tokenize_chunks(source.data(), source.size(), true, threads);
+	}
+
+	void Lexer::tokenize(const preprocess::ExpandedSource& source, std::size_t threads)
+	{
+		if (source._text.size() > UINT32_MAX)
+			throw MiniC_Universal_Exception{ "The program is too large", 0, 0 };
+		reset();
+		_source_map._lines = source._lines;
+		_source_map._files = source._files;
+		_source_map._file_ranges = source._file_ranges;
+		_source_map._expansions = source._expansions;
+		tokenize_chunks(source._text.c_str(), source._text.size(), false, threads);
+	}
+
+	/*
+	 * a chunk is whole lines, and the minus check (`unminusable()`) only looks back on its own line,
+	 * so a chunk start needs no fix-up: the line is lexed as the serial loop lexes it.
+	 * only a block comment goes over lines, a chunk is lexed again if the chunk before ends in one, which is rare.
+	 * the error of the first failed chunk is thrown, as the serial loop stops at the first error.
+	 */
+	void Lexer::tokenize_chunks(const char* text, std::size_t size, bool strip_cr, std::size_t threads)
+	{
+		struct chunk_t
+		{
+			std::size_t _begin, _end;               // line starts in [_begin, _end)
+			lexed_lines_t _lines;
+			bool _failed = false;
+
+			chunk_t(std::size_t begin, std::size_t end, util::Interner& names) :_begin(begin), _end(end), _lines(names) {}
+		};
+
+		if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<chunk_t> chunks;
+		for (std::size_t begin = 0; begin <= size && chunks.size() < threads; )
+		{
+			const std::size_t cut = begin + (size - begin) / (threads - chunks.size());
+			const char* eol = static_cast<const char*>(std::memchr(text + cut, '\n', size - cut));
+			const std::size_t end = eol && chunks.size() + 1 < threads ? eol - text + 1 : size + 1;
+			chunks.emplace_back(begin, end, *_names);
+			begin = end;
+		}
+
+		auto work = [text, size, strip_cr, recover = _recover](chunk_t& chunk) {
+			chunk._failed = !lex_lines(text, size, chunk._begin, chunk._end, strip_cr, recover, chunk._lines);
+		};
+		std::vector<std::thread> workers;
+		for (std::size_t i = 1; i < chunks.size(); i++) workers.emplace_back(work, std::ref(chunks[i]));
+		work(chunks.front()); // the calling thread is a worker too
+		for (auto& worker : workers) worker.join();
+
+		for (std::size_t i = 1; i < chunks.size() && !chunks[i - 1]._failed; i++)
+			if (chunks[i - 1]._lines._in_comment)
+			{
+				chunks[i] = chunk_t{ chunks[i]._begin, chunks[i]._end, *_names };
+				chunks[i]._lines._in_comment = true;
+				work(chunks[i]);
+			}
+
+		for (chunk_t& chunk : chunks)
+		{
+			lexed_lines_t& lines = chunk._lines;
+			_line_starts.insert(_line_starts.end(), lines._line_starts.begin(), lines._line_starts.end());
+			if (chunk._failed)
+			{
+				const std::size_t index = _line_starts.size() - 1;
+				throw MiniC_Universal_Exception{ std::move(lines._error._msg),
+					_map->_lines.empty() ? index + 1 : _map->_lines[index], lines._error._position };
+			}
+			_comment_lines.insert(_comment_lines.end(), lines._comment_lines.begin(), lines._comment_lines.end());
+			_token_stream.append(std::move(lines._tokens), static_cast<std::uint32_t>(_diagnostics.size()));
+			for (Diagnostic& diagnostic : lines._diagnostics) _diagnostics.push_back(std::move(diagnostic));
+		}
+		_lines_lexed = _line_starts.size();
+	}
+
+	void Lexer::tokenize_text(std::string text, const std::string& name)
+	{
+		if (text.size() > UINT32_MAX)
+			throw MiniC_Universal_Exception{ "The file is too large", 0, 0 };
+		check_utf8(text.c_str(), 0, text.size(), 1);
+		reset();
+		_source_map._files.push_back(name); // no `_lines`, the i-th line is line i + 1
+		tokenize_chunks(text.c_str(), text.size(), true, 1);
+		_edit_text = std::move(text);
+		_editing = true;
+		_names_built = _names->size();
+	}
+
+	/*
+	 * a token never goes over a line end, and the minus check (`unminusable()`) only looks back on its own line,
+	 * so the lines which the edit does not touch are lexed as before, only their places change,
+	 * unless the edit opens or closes a block comment: then the lines after are lexed again until one starts as it did.
+	 * the diagnostics are in the order of the text, as the tokens are.
+	 */
+	void Lexer::edit(std::size_t begin, std::size_t end, std::string_view replacement)
+	{
+		if (!_editing)
+			throw MiniC_Universal_Exception{ "no text to edit, call tokenize_text() first", 0, 0 };
+		if (begin > end || end > _edit_text.size())
+			throw MiniC_Universal_Exception{ "the edit is out of the text", 0, 0 };
+		if (_edit_text.size() - (end - begin) + replacement.size() > UINT32_MAX)
+			throw MiniC_Universal_Exception{ "The file is too large", 0, 0 };
+
+		// the lines `[first, last]` are replaced by the lines in `[old_begin, old_end + shift)` of the new text
+		const std::size_t old_size = _edit_text.size();
+		auto end_of = [this, old_size](std::size_t line) -> std::size_t {
+			return line + 1 < _line_starts.size() ? _line_starts[line + 1] : old_size + 1;
+		};
+		auto in_comment = [this](std::size_t line_start) {
+			return std::binary_search(_comment_lines.begin(), _comment_lines.end(), line_start);
+		};
+		const std::size_t first = line_index(begin);
+		std::size_t last = line_index(end);
+		const std::size_t old_begin = _line_starts[first];
+		std::size_t old_end = end_of(last);
+		const std::int64_t shift = static_cast<std::int64_t>(replacement.size()) - static_cast<std::int64_t>(end - begin);
+
+		const std::string removed = _edit_text.substr(begin, end - begin);
+		_edit_text.replace(begin, end - begin, replacement);
+		try {
+			check_utf8(_edit_text.c_str(), old_begin, std::min<std::size_t>(old_end + shift, _edit_text.size()), first + 1);
+		}
+		catch (const MiniC_Universal_Exception&) {
+			_edit_text.replace(begin, replacement.size(), removed);
+			throw;
+		}
+		lexed_lines_t lines{ *_names };
+		lines._in_comment = in_comment(old_begin);
+		bool lexed = lex_lines(_edit_text.c_str(), _edit_text.size(), old_begin, old_end + shift, true, _recover, lines);
+		while (lexed && last + 1 < _line_starts.size() && lines._in_comment != in_comment(old_end))
+		{
+			const std::size_t next_end = end_of(++last);
+			lexed = lex_lines(_edit_text.c_str(), _edit_text.size(), old_end + shift, next_end + shift, true, _recover, lines);
+			old_end = next_end;
+		}
+		if (!lexed)
+		{
+			_edit_text.replace(begin, replacement.size(), removed);
+			throw MiniC_Universal_Exception{ std::move(lines._error._msg), first + lines._line_starts.size(), lines._error._position };
+		}
+
+		auto before = [](const Diagnostic& diagnostic, std::size_t offset) { return diagnostic._loc._offset < offset; };
+		const std::size_t first_diagnostic = std::lower_bound(_diagnostics.begin(), _diagnostics.end(), old_begin, before) - _diagnostics.begin();
+		const std::size_t last_diagnostic = std::lower_bound(_diagnostics.begin(), _diagnostics.end(), old_end, before) - _diagnostics.begin();
+		const std::size_t first_token = _token_stream.find(old_begin);
+		_token_stream.splice(first_token, _token_stream.find(old_end), std::move(lines._tokens), static_cast<std::uint32_t>(first_diagnostic),
+			shift, static_cast<std::int64_t>(lines._diagnostics.size()) - static_cast<std::int64_t>(last_diagnostic - first_diagnostic));
+
+		for (std::size_t i = last_diagnostic; i < _diagnostics.size(); i++)
+			_diagnostics[i]._loc._offset = static_cast<std::uint32_t>(_diagnostics[i]._loc._offset + shift);
+		replace_range(_diagnostics, first_diagnostic, last_diagnostic, lines._diagnostics);
+		for (std::size_t i = last + 1; i < _line_starts.size(); i++)
+			_line_starts[i] = static_cast<std::uint32_t>(_line_starts[i] + shift);
+		replace_range(_line_starts, first, last + 1, lines._line_starts);
+		const std::size_t first_comment = std::lower_bound(_comment_lines.begin(), _comment_lines.end(), old_begin) - _comment_lines.begin();
+		const std::size_t last_comment = std::lower_bound(_comment_lines.begin(), _comment_lines.end(), old_end) - _comment_lines.begin();
+		for (std::size_t i = last_comment; i < _comment_lines.size(); i++)
+			_comment_lines[i] = static_cast<std::uint32_t>(_comment_lines[i] + shift);
+		replace_range(_comment_lines, first_comment, last_comment, lines._comment_lines);
+		_lines_lexed = _line_starts.size();
+		_front = std::min(_front, first_token);  // the tokens lexed again are not popped
+
+		// the names of the lines lexed again stay in the table, such as each prefix of a name typed char by char
+		if (_own_names && _names->size() >= 2 * std::max<std::size_t>(_names_built, 1024))
 		{
-			inputFile.getline(buffer, MAXSIZE - 1);
-			line_num++;
-			auto result = Mini_C::lexer::tokenize(buffer, strlen(buffer));
-			std::visit(overloaded{
-					[line_num](const Mini_C::lexer::analyzers::Token_Ex& e) {
-						throw Mini_C::MiniC_Universal_Exception{
-								std::move(const_cast<Mini_C::lexer::analyzers::Token_Ex&>(e)._msg),
-								line_num, e._position }; },
-					[line_num, this](const std::vector<Mini_C::lexer::token_info>& tokens) { for (token_info const& token : tokens) this->_token_stream.emplace_back(token, line_num); },
-				}, result);
+			std::unique_ptr<util::Interner> names = std::make_unique<util::Interner>();
+			_token_stream.rename(*names);
+			_own_names = std::move(names);
+			_names = _own_names.get();
+			_names_built = _names->size();
 		}
-		inputFile.close();
-		//}
-		// catch (const Mini_C::MiniC_Base_Exception& e) { e.printException(); }
-		// catch (const std::exception& e) { std::cout << e.what() << std::endl; }
-		// catch (...) { std::cout << "WTF: Unexpected Exception" << std::endl; }
 	}
 
-	std::size_t Lexer::size() const { return _token_stream.size(); }
+	void Lexer::stream(const std::string& filename, std::size_t capacity)
+	{
+		reset();
+		if (!_stream_file.open(filename))
+		{
+			std::cout << "failed to open: " << std::quoted(filename) << std::endl;
+			return;
+		}
+		if (_stream_file.size() > UINT32_MAX)
+			throw MiniC_Universal_Exception{ "The file is too large", 0, 0 };
+		check_utf8(_stream_file.data(), 0, _stream_file.size(), 1);
+		_source_map._files.push_back(filename); // no `_lines`, the i-th line is line i + 1
+		_streaming = true;
+		_capacity = capacity;
+		_text = _stream_file.data();
+		_text_size = _stream_file.size();
+	}
 
-	bool Lexer::empty() const { return _token_stream.empty(); }
+	void Lexer::stream(const preprocess::ExpandedSource& source, std::size_t capacity)
+	{
+		if (source._text.size() > UINT32_MAX)
+			throw MiniC_Universal_Exception{ "The program is too large", 0, 0 };
+		reset();
+		_map = &source; // not copied, `source` outlives the lexing
+		_streaming = true;
+		_capacity = capacity;
+		_text = source._text.c_str();
+		_text_size = source._text.size();
+	}
+
+	/*
+	 * lex the next lines into the drained buffer, the lines are cut as `tokenize()` does,
+	 * and a file drops the '\r' of "\r\n" as `SourceBuffer::lines()` does.
+	 */
+	bool Lexer::refill()
+	{
+		_token_stream.drop();
+		_front = 0;
+		while (_token_stream.size() < _capacity && _next_line <= _text_size)
+		{
+			const char* eol = static_cast<const char*>(std::memchr(_text + _next_line, '\n', _text_size - _next_line));
+			const std::size_t end = eol ? eol - _text : _text_size;
+			std::size_t size = end - _next_line;
+			if (_map->_lines.empty() && size > 0 && _text[_next_line + size - 1] == '\r') size--;
+			const std::size_t line_num = _map->_lines.empty() ? _lines_lexed + 1 : _map->_lines[_lines_lexed];
+			tokenize_line(_text + _next_line, size, line_num, _next_line);
+			_next_line = end + 1;
+		}
+		return !_token_stream.empty();
+	}
+
+	bool Lexer::next(Token& token)
+	{
+		if (_front == _token_stream.size() && (!_streaming || !refill())) return false;
+		token = _token_stream[_front++];
+		return true;
+	}
+
+	void Lexer::release()
+	{
+		if (_streaming) _token_stream.release(_front);
+	}
+
+	void Lexer::tokenize_line(const char* s, const std::size_t size, const std::size_t line_num, const std::size_t offset)
+	{
+		if (!_streaming || _lines_lexed % line_step == 0)
+			_line_starts.push_back(static_cast<std::uint32_t>(offset));
+		_lines_lexed++;
+		std::vector<token_info> tokens;
+		_line_names._names = _names;
+		_line_names._symbols.clear();
+		std::vector<analyzers::Token_Ex> errors = Mini_C::lexer::tokenize(s, size, tokens, _recover, _in_comment, &_line_names);
+		if (!_recover && !errors.empty())
+			throw Mini_C::MiniC_Universal_Exception{ std::move(errors.front()._msg), line_num, errors.front()._position };
+		push_line(_token_stream, _diagnostics, tokens, errors, _line_names, offset);
+	}
+
+	// when streaming, the lines after the kept start are counted in the text
+	std::size_t Lexer::line_index(std::size_t offset) const
+	{
+		const std::size_t kept = std::upper_bound(_line_starts.begin(), _line_starts.end(), offset) - _line_starts.begin() - 1;
+		if (!_streaming) return kept;
+		std::size_t index = kept * line_step;
+		for (const char* p = _text + _line_starts[kept]; (p = static_cast<const char*>(std::memchr(p, '\n', _text + offset - p))) != nullptr; p++)
+			index++;
+		return index;
+	}
+
+	std::size_t Lexer::line_start(std::size_t index) const
+	{
+		if (!_streaming) return _line_starts[index];
+		std::size_t start = _line_starts[index / line_step];
+		for (std::size_t i = index % line_step; i > 0; i--)
+			start = static_cast<const char*>(std::memchr(_text + start, '\n', _text_size - start)) - _text + 1;
+		return start;
+	}
+
+	std::size_t Lexer::line_of(SourceLoc loc) const
+	{
+		const std::size_t index = line_index(loc._offset);
+		return _map->_lines.empty() ? index + 1 : _map->_lines[index];
+	}
+
+	std::size_t Lexer::pos_of(SourceLoc loc) const { return loc._offset - line_start(line_index(loc._offset)); }
+
+	/*
+	 * in a macro expansion: the place of the outermost macro.
+	 * otherwise, the text between the last expansion on the line and the token is not changed,
+	 * so count from the end of the replaced text "foo(a, b)".
+	 */
+	SourceLocation Lexer::resolve(SourceLoc loc) const
+	{
+		const std::size_t index = line_index(loc._offset);
+		SourceLocation result{ _map->file_of(index), line_of(loc), loc._offset - line_start(index), {} };
+
+		const preprocess::ExpansionMap& expansions = _map->_expansions;
+		if (expansions.size() == 0) return result;
+		const auto stack = expansions.stack_at(loc._offset);
+		preprocess::ExpansionMap::expansion_t last;
+		if (!stack.empty())
+		{
+			result._column = stack.front()._call_column;
+			for (auto const& expansion : stack)
+				result._macros.push_back(expansion._macro);
+		}
+		else if (expansions.last_before(loc._offset, last) && line_index(last._end) == index)
+			result._column = last._call_column + last._call_size + (loc._offset - last._end);
+		return result;
+	}
+
+	std::size_t Lexer::size() const { return _token_stream.size() - _front; }
+
+	bool Lexer::empty() const { return size() == 0; }
 
 #define CHECK_EMPTY_AND_UPDATE do{                                                  \
-    if (_token_stream.empty())                                                      \
+    if (empty())                                                                    \
         throw MiniC_Universal_Exception("Need more tokens", cur_line, cur_pos);     \
-    cur_pos = _token_stream.front()._pos;                                           \
-    cur_line = _token_stream.front()._line;                                         \
+    cur_pos = pos_of((*this)[0]._loc);                                              \
+    cur_line = line_of((*this)[0]._loc);                                            \
 	} while(0)
 
 	Token Lexer::getToken() {
 		CHECK_EMPTY_AND_UPDATE;
-		return _token_stream.front();
+		return (*this)[0];
 	}
 
 	void Lexer::popToken() {
 		CHECK_EMPTY_AND_UPDATE;
-		_token_stream.pop_front();
+		_front++;
 	}
 
 	Token Lexer::consumeToken() {
 		CHECK_EMPTY_AND_UPDATE;
-		const Token token = _token_stream.front();
-		_token_stream.pop_front();
-		return token;
+		return _token_stream[_front++];
 	}
 
 
 	void Lexer::print(std::ostream& out) const {
-		for (Token const& token : _token_stream)
+		for (std::size_t i = 0; i < size(); i++)
 		{
-			out << "line: " << token._line << " \tpos:" << token._pos << "\t\t";
-			std::visit(overloaded{
-					[&out](const Mini_C::lexer::type& _type) { out << "type: " << "\t\t\t" << std::quoted(Mini_C::lexer::type2str(_type)) << std::endl; },
-					[&out](const Mini_C::lexer::identifier& _identifier) { out << "identifier: " << "\t\t" << _identifier << std::endl; },
-					[&out](const Mini_C::lexer::numeric_t& _num) { out << "numeric: " << "\t\t" << std::quoted(Mini_C::lexer::type2str(num_t2type(std::get<const Mini_C::lexer::numeric_type>(_num)))) << "\t"; TEST::num_print(_num, out); out << std::endl; },
-					[&out](const Mini_C::lexer::string_literal_t& _str) { out << "string literal: " << "\t" << std::quoted(std::get<const std::string>(_str)) << std::endl; },
-					[&out](auto) { out << "WTF: tokenizer" << std::endl; },
-				}, token._token);
+			const Token token = (*this)[i];
+			out << "line: " << line_of(token._loc) << " \tpos:" << pos_of(token._loc) << "\t\t";
+			switch (token._type)
+			{
+			case type::IDENTIFIER:
+				out << "identifier: " << "\t\t" << _token_stream.identifier_of(token) << std::endl;
+				break;
+			case type::NUMBER_CONSTANT:
+				out << "numeric: " << "\t\t" << std::quoted(Mini_C::lexer::type2str(num_t2type(std::get<const Mini_C::lexer::numeric_type>(_token_stream.number_of(token))))) << "\t";
+				TEST::num_print(_token_stream.number_of(token), out);
+				out << std::endl;
+				break;
+			case type::STR_LITERAL:
+				out << "string literal: " << "\t" << std::quoted(_token_stream.literal_of(token)) << std::endl;
+				break;
+			case type::ERROR:
+				out << "error: " << "\t\t\t" << _diagnostics[token._payload]._msg << std::endl;
+				break;
+			default:
+				out << "type: " << "\t\t\t" << std::quoted(Mini_C::lexer::type2str(token._type)) << std::endl;
+			}
 		}
 	}
 
-	type getType(const Token& token)
+
+	/*
+	 * class member function for TokenStream.
+	 */
+	void TokenStream::push(const token_info& token, std::uint32_t line_offset, std::uint32_t given)
+	{
+		std::uint32_t payload = 0;
+		const type terminal = std::visit(overloaded{
+				[&payload, given](const type& _type) {
+					if (_type == type::ERROR) payload = given;
+					return _type; },
+				[&payload, given, this](const identifier& _identifier) {
+					payload = _identifier.empty() ? given : _names->intern(_identifier);
+					return type::IDENTIFIER; },
+				[&payload, this](const numeric_t& _num) {
+					payload = _first_number + static_cast<std::uint32_t>(_numbers.size());
+					_numbers.push_back(_num);
+					return type::NUMBER_CONSTANT; },
+				[&payload, this](const string_literal_t& _str) {
+					payload = _first_literal + static_cast<std::uint32_t>(_literals.size());
+					_literals.push_back(std::get<const std::string>(_str));
+					return type::STR_LITERAL; },
+			}, std::get<token_t>(token));
+		_types.push_back(terminal);
+		_locs.push_back(SourceLoc{ static_cast<std::uint32_t>(line_offset + std::get<pos_t>(token)) });
+		_payloads.push_back(payload);
+	}
+
+	token_t TokenStream::value_of(const Token& token) const
 	{
-		return std::visit(Mini_C::util::overloaded{
-				[](const lexer::type& type) { return type; },
-				[](const lexer::identifier) { return lexer::type::IDENTIFIER; },
-				[](const lexer::numeric_t) { return lexer::type::NUMBER_CONSTANT; },
-				[](const lexer::string_literal_t) { return lexer::type::STR_LITERAL; },
-			}, token._token);
+		switch (token._type)
+		{
+		case type::IDENTIFIER: return token_t{ std::in_place_type<identifier>, std::string{ identifier_of(token) } };
+		case type::NUMBER_CONSTANT:
+			if (token._payload < _first_number) break;
+			return token_t{ std::in_place_type<numeric_t>, number_of(token) };
+		case type::STR_LITERAL:
+			if (token._payload < _first_literal) break;
+			return token_t{ std::in_place_type<string_literal_t>, literal_of(token) };
+		default: break;
+		}
+		return token_t{ token._type };
+	}
+
+	void TokenStream::append(TokenStream&& other, std::uint32_t first_diagnostic)
+	{
+		splice(size(), size(), std::move(other), first_diagnostic, 0, 0);
+	}
+
+	void TokenStream::splice(std::size_t first, std::size_t last, TokenStream&& other, std::uint32_t first_diagnostic,
+		std::int64_t shift, std::int64_t error_shift)
+	{
+		for (std::size_t i = last; i < size(); i++)
+		{
+			_locs[i]._offset = static_cast<std::uint32_t>(_locs[i]._offset + shift);
+			if (_types[i] == type::ERROR) _payloads[i] = static_cast<std::uint32_t>(_payloads[i] + error_shift);
+		}
+
+		for (std::size_t i = first; i < last; i++)
+		{
+			if (_types[i] == type::STR_LITERAL && _payloads[i] >= _first_literal) _dead_literals++;
+			else if (_types[i] == type::NUMBER_CONSTANT && _payloads[i] >= _first_number) _dead_numbers++;
+		}
+
+		// the values of `other` go after the ones here
+		const std::uint32_t first_literal = _first_literal + static_cast<std::uint32_t>(_literals.size());
+		const std::uint32_t first_number = _first_number + static_cast<std::uint32_t>(_numbers.size());
+		for (std::size_t i = 0; i < other.size(); i++)
+		{
+			std::uint32_t& payload = other._payloads[i];
+			switch (other._types[i])
+			{
+			case type::STR_LITERAL: payload = first_literal + payload - other._first_literal; break;
+			case type::NUMBER_CONSTANT: payload = first_number + payload - other._first_number; break;
+			case type::ERROR: payload = first_diagnostic + payload; break;
+			default: break;
+			}
+		}
+		replace_range(_types, first, last, other._types);
+		replace_range(_locs, first, last, other._locs);
+		replace_range(_payloads, first, last, other._payloads);
+		for (std::string& literal : other._literals) _literals.push_back(std::move(literal));
+		for (const numeric_t& number : other._numbers) _numbers.push_back(number);
+		other.clear();
+		if (_dead_literals > _literals.size() - _dead_literals || _dead_numbers > _numbers.size() - _dead_numbers) compact();
+	}
+
+	// the live values are moved into new pools in the order of the tokens, the dropped ones (payload before the pool) stay dropped
+	void TokenStream::compact()
+	{
+		std::vector<std::string> literals;
+		std::vector<numeric_t> numbers;
+		literals.reserve(_literals.size() - _dead_literals);
+		numbers.reserve(_numbers.size() - _dead_numbers);
+		for (std::size_t i = 0; i < size(); i++)
+		{
+			std::uint32_t& payload = _payloads[i];
+			if (_types[i] == type::STR_LITERAL && payload >= _first_literal)
+			{
+				literals.push_back(std::move(_literals[payload - _first_literal]));
+				payload = _first_literal + static_cast<std::uint32_t>(literals.size() - 1);
+			}
+			else if (_types[i] == type::NUMBER_CONSTANT && payload >= _first_number)
+			{
+				numbers.push_back(_numbers[payload - _first_number]);
+				payload = _first_number + static_cast<std::uint32_t>(numbers.size() - 1);
+			}
+		}
+		_literals = std::move(literals);
+		_numbers = std::move(numbers);
+		_dead_literals = 0;
+		_dead_numbers = 0;
+	}
+
+	std::size_t TokenStream::find(std::size_t offset) const
+	{
+		return std::lower_bound(_locs.begin(), _locs.end(), offset,
+			[](SourceLoc loc, std::size_t offset) { return loc._offset < offset; }) - _locs.begin();
+	}
+
+	void TokenStream::clear()
+	{
+		_types.clear();
+		_locs.clear();
+		_payloads.clear();
+		_literals.clear();
+		_numbers.clear();
+		_first_literal = 0;
+		_first_number = 0;
+		_dead_literals = 0;
+		_dead_numbers = 0;
+		_released = 0;
+		_released_literal = 0;
+		_released_number = 0;
+		_dropped_literal = 0;
+		_dropped_number = 0;
+	}
+
+	void TokenStream::drop()
+	{
+		_types.clear();
+		_locs.clear();
+		_payloads.clear();
+		_released = 0;
+		_dropped_literal = _first_literal + static_cast<std::uint32_t>(_literals.size());
+		_dropped_number = _first_number + static_cast<std::uint32_t>(_numbers.size());
+	}
+
+	/*
+	 * the values are in the order of the tokens, so the released ones are a prefix of each pool,
+	 * which is erased once it is the half: each value is moved O(1) times, however often it is called.
+	 */
+	void TokenStream::release(std::size_t upto)
+	{
+		_released_literal = std::max(_released_literal, _dropped_literal);
+		_released_number = std::max(_released_number, _dropped_number);
+		for (; _released < upto; _released++)
+		{
+			if (_types[_released] == type::STR_LITERAL) _released_literal = _payloads[_released] + 1;
+			else if (_types[_released] == type::NUMBER_CONSTANT) _released_number = _payloads[_released] + 1;
+		}
+		const std::size_t literals = _released_literal - _first_literal, numbers = _released_number - _first_number;
+		if (2 * literals > _literals.size())
+		{
+			_literals = std::vector<std::string>(std::make_move_iterator(_literals.begin() + literals), std::make_move_iterator(_literals.end()));
+			_first_literal = _released_literal;
+		}
+		if (2 * numbers > _numbers.size())
+		{
+			_numbers = std::vector<numeric_t>(_numbers.begin() + numbers, _numbers.end()); // `numeric_t` is not assignable
+			_first_number = _released_number;
+		}
+	}
+
+	void TokenStream::rename(util::Interner& names)
+	{
+		constexpr util::symbol_t none = ~util::symbol_t(0);
+		std::vector<util::symbol_t> renamed(_names->size(), none);
+		for (std::size_t i = 0; i < size(); i++)
+		{
+			if (_types[i] != type::IDENTIFIER) continue;
+			util::symbol_t& symbol = renamed[_payloads[i]];
+			if (symbol == none) symbol = names.intern(_names->name(_payloads[i]));
+			_payloads[i] = symbol;
+		}
+		_names = &names;
 	}
 
 } // end namespace MiniC::lexer
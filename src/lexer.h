@@ -9,9 +9,14 @@
 #include <string>
 #include <unordered_map>
 #include <vector>
-#include <deque>
+#include <cstdint>
+#include <memory>
+#include <string_view>
 #include "miniC_exception.h"
+#include "preprocess.h"
 #include "../util/util.h"
+#include "../util/interner.h"
+#include "../util/source_buffer.h"
 
 namespace std {
 	template<> struct hash<const std::string> {
@@ -41,7 +46,18 @@ namespace Mini_C::lexer
 	 * Promise: The order of `numeric_type` is same in `type`.
 	 */
 	enum class numeric_type { BOOLEAN, CHAR, I16, I32, U16, U32, F32, F64 };
-	using numeric_t = std::tuple<const double, const numeric_type>;
+
+	/*
+	 * value of a number in its own width, the alternatives are in the order of `numeric_type`.
+	 */
+	using number_value = std::variant<bool, char, std::int16_t, std::int32_t, std::uint16_t, std::uint32_t, float, double>;
+	using numeric_t = std::tuple<const number_value, const numeric_type>;
+
+	// the value converted to `T`, such as the operands of the conditions of "#if"
+	template<typename T> T numeric_cast(const numeric_t& number)
+	{
+		return std::visit([](auto value) { return static_cast<T>(value); }, std::get<0>(number));
+	}
 
 
 	/*
@@ -115,10 +131,20 @@ namespace Mini_C::lexer
 		LEFT_CURLY_BRACKETS, RIGHT_CURLY_BRACKETS,   // curly brackets   : "{", "}"
 
 		__EOF__,
+
+		ERROR,                                       // a lexical error, not a terminal of the grammar
 	};
 
 	type num_t2type(numeric_type num_t) noexcept;
-	static const std::unordered_map<std::string, type> keywords =
+
+	// an operator or a keyword, and its type
+	struct keyword_t {
+		std::string_view _text;
+		type _type;
+	};
+
+	// every operator and keyword, the lexers build their tables from it
+	inline constexpr keyword_t keyword_list[] =
 	{
 		/* arithmetic operator */
 		{ "+", type::ADD }, { "-", type::SUB }, { "*", type::MUL }, { "/", type::DIV }, { "%", type::MOD },
@@ -179,6 +205,13 @@ namespace Mini_C::lexer
 		// { "$eof$", type::__EOF__ }, // no use
 	};
 
+	static const std::unordered_map<std::string, type> keywords = [] {
+		std::unordered_map<std::string, type> map;
+		for (const keyword_t& keyword : keyword_list)
+			map.emplace(keyword._text, keyword._type);
+		return map;
+	}();
+
 	// for display
 	std::string type2str(type _type) noexcept;
 	static const std::unordered_map<type, std::string> keyword2str =
@@ -241,6 +274,8 @@ namespace Mini_C::lexer
 		{ type::LEFT_CURLY_BRACKETS, "{" },   { type::RIGHT_CURLY_BRACKETS, "}" },
 
 		{ type::__EOF__, "$eof$" },
+
+		{ type::ERROR, "$error$" },
 	};
 
 
@@ -280,53 +315,251 @@ namespace Mini_C::lexer
 	using token_info = std::tuple<token_t, pos_t>;
 	std::variant<std::vector<token_info>, analyzers::Token_Ex> tokenize(const char* s, const std::size_t size) noexcept;
 
+	/*
+	 * the names of a scan interned as they are met, no `std::string` is made for them:
+	 *     in `r` such a name is an empty `identifier` (no name is empty, and an empty string takes no memory),
+	 *     its symbol is the next one of `_symbols`.
+	 */
+	struct name_sink_t
+	{
+		util::Interner* _names;
+		std::vector<util::symbol_t> _symbols;
+	};
+
+	/*
+	 * the same scan, no exception is thrown inside, the errors are returned in order.
+	 *     recover    : an `ERROR` token at the place of each error goes into `r`, and the scan goes on after the char;
+	 *                  otherwise the scan stops at the first error.
+	 *     in_comment : the line starts in a block comment, then if the line ends in one, which goes on in the next line.
+	 *     names      : if not null, the names go into it, otherwise they are `identifier`s in `r`.
+	 * a line comment ends with the line, `tokenize(s, size)` and the analyzers end a block comment which is not closed with the line too.
+	 */
+	std::vector<analyzers::Token_Ex> tokenize(const char* s, const std::size_t size, std::vector<token_info>& r, bool recover, bool& in_comment,
+		name_sink_t* names = nullptr) noexcept;
 
-	/* Token struct
-	 *     members are all const.
+	// the former chain of analyzers, which gives the same result as `tokenize()`, kept for comparing
+	std::variant<std::vector<token_info>, analyzers::Token_Ex> tokenize_by_analyzers(const char* s, const std::size_t size) noexcept;
+
+
+	/*
+	 * location of a token in 32 bits: offset of the token in the text given to the lexer
+	 *     (`ExpandedSource::_text`, or the file), the lexer maps it back on demand.
+	 */
+	struct SourceLoc
+	{
+		std::uint32_t _offset;
+	};
+
+	/*
+	 * `SourceLoc` mapped back to the original file
+	 *     _macros : the macros which the token is expanded from, the outermost first,
+	 *               then `_line` and `_column` are the place where the outermost macro is used.
+	 */
+	struct SourceLocation
+	{
+		std::string_view _file;
+		std::size_t _line;
+		std::size_t _column;
+		std::vector<std::string_view> _macros;
+	};
+
+
+	/*
+	 * Token record, 12 bytes, copied and assigned as plain data.
+	 *     _type    : terminal id, the column of the LR1 action table.
+	 *     _payload : for `IDENTIFIER`, the interned name (in `Lexer::names()`),
+	 *                for `NUMBER_CONSTANT` and `STR_LITERAL`, index of the value in the pool of its kind in `TokenStream`,
+	 *                for `ERROR`, index in `Lexer::diagnostics()`,
+	 *                0 otherwise.
 	 */
-#include <cassert>
 	struct Token
 	{
-		pos_t _pos;
-		line_t _line;
-		token_t _token;
-		Token(token_info const& _token_info, line_t line_num)
-			:
-			_pos(std::get<pos_t>(_token_info)),
-			_line(line_num),
-			_token(std::get<token_t>(_token_info))
-		{}
-		Token(const Token&) = default;
-		Token& operator=(const Token&) = default;
-		Token(Token&&) = default;
-		Token& operator=(Token&& other)
-		{
-			std::cerr << "WTF" << std::endl;
-			assert(false);
-			return *this;
-		}
+		type _type;
+		SourceLoc _loc;
+		std::uint32_t _payload = 0;
 	};
+	static_assert(sizeof(Token) <= 16, "a token should stay small");
+
+	inline lexer::type getType(const Token& token) { return token._type; }
+
 
+	/*
+	 * tokens as a structure of arrays, the parser reads `_types` only.
+	 *     the numbers and the literals are kept in pools, each token indexes its pool by `Token::_payload`,
+	 *     the identifiers are interned in the table of the lexer, `util::symbols()` for a stream of its own.
+	 */
+	class TokenStream
+	{
+	public:
+		TokenStream() = default;
+		explicit TokenStream(util::Interner& names) :_names(&names) {}
+
+		std::size_t size() const { return _types.size(); }
+		bool empty() const { return _types.empty(); }
+		Token operator[](std::size_t pos) const { return Token{ _types[pos], _locs[pos], _payloads[pos] }; }
+
+		std::string_view identifier_of(const Token& token) const { return _names->name(token._payload); }
+		const numeric_t& number_of(const Token& token) const { return _numbers[token._payload - _first_number]; }
+		const std::string& literal_of(const Token& token) const { return _literals[token._payload - _first_literal]; }
+		token_t value_of(const Token& token) const;     // as `tokenize()` gave it, only the type if the value is dropped
+
+		// `payload` is for `ERROR`, the diagnostic, and for an empty `identifier`, the symbol from a `name_sink_t`
+		void push(const token_info& token, std::uint32_t line_offset, std::uint32_t payload = 0);
+		void append(TokenStream&& other, std::uint32_t first_diagnostic);  // the payloads of `other` are moved after the ones here, the names are in the same table
+		/*
+		 * `[first, last)` replaced by `other`, the tokens after are moved by `shift` chars and their `ERROR` payloads by `error_shift`.
+		 * the values of the replaced tokens are dead, once they outnumber the live ones the pools are compacted,
+		 * which gives the numbers and the literals new payloads.
+		 */
+		void splice(std::size_t first, std::size_t last, TokenStream&& other, std::uint32_t first_diagnostic,
+			std::int64_t shift, std::int64_t error_shift);
+		std::size_t find(std::size_t offset) const;     // the first token at `offset` or after it
+		void clear();
+		void drop();    // the tokens are cleared, their values stay in the pools until `release()`
+		/*
+		 * the values of the tokens before `upto`, and of the dropped tokens, are not read any more,
+		 * they leave the pools, but the payloads go on counting, so the tokens kept are never given a wrong value.
+		 */
+		void release(std::size_t upto);
+		void rename(util::Interner& names);    // the identifiers interned again in `names`, which is used from then on
 
-	lexer::type getType(const Token& token);
+	private:
+		void compact();
+
+		util::Interner* _names = &util::symbols();
+		std::vector<type> _types;
+		std::vector<SourceLoc> _locs;
+		std::vector<std::uint32_t> _payloads;
+		std::vector<std::string> _literals;
+		std::vector<numeric_t> _numbers;
+		std::uint32_t _first_literal = 0;       // payload of `_literals[0]`
+		std::uint32_t _first_number = 0;        // payload of `_numbers[0]`
+		std::size_t _dead_literals = 0;         // in the pools, no token has them since a `splice()`
+		std::size_t _dead_numbers = 0;
+		std::size_t _released = 0;              // the tokens before it are released
+		std::uint32_t _released_literal = 0;    // the payloads before it are released, still in the pool until they are the half
+		std::uint32_t _released_number = 0;
+		std::uint32_t _dropped_literal = 0;     // the payloads before it are of the dropped tokens
+		std::uint32_t _dropped_number = 0;
+	};
 
 
 	class Lexer
 	{
 	public:
+		/*
+		 * a file, and the text of `tokenize_text()` and `edit()`, must be valid UTF-8 or "invalid UTF-8" is thrown, even if
+		 * the errors are recovered, an `ExpandedSource` is not checked again: the preprocessor checks the files it reads.
+		 */
 		void tokenize(const std::string filename);
+		void tokenize(const preprocess::ExpandedSource& source); // line numbers refer to the original file
+
+		/*
+		 * the same tokens as above, the text is cut at line starts into one chunk per thread (0: one per core),
+		 * the chunks are lexed concurrently and joined in order.
+		 */
+		void tokenize(const std::string filename, std::size_t threads);
+		void tokenize(const preprocess::ExpandedSource& source, std::size_t threads);
+
+		/*
+		 * streaming: lines are lexed on demand by `next()`, into a buffer of about `capacity` tokens
+		 *     (one line more if a line has more), which is refilled when it is drained.
+		 *     the file stays mapped, `source` must outlive the lexing, its maps to the original file are not copied.
+		 *     the number and literal values (`tokens()`) of the tokens given by `next()` are kept until `release()`,
+		 *     a consumer which does not read them, or keeps its own copies, releases as it goes.
+		 *     `line_of()`, `pos_of()` and `resolve()` work for all tokens, only every `line_step`-th line start is kept.
+		 * so the memory grows with the file only by a line start per `line_step` lines, a diagnostic per recovered error,
+		 * the values not released, and the distinct names (`names()`).
+		 */
+		void stream(const std::string& filename, std::size_t capacity = 4096);
+		void stream(const preprocess::ExpandedSource& source, std::size_t capacity = 4096);
+		bool next(Token& token);    // false after the last token, `throw MiniC_Universal_Exception`
+		void release();             // the values of the tokens given by `next()` so far are not read any more
+		static constexpr std::size_t line_step = 256;
+
+		/*
+		 * off by default, then a lexical error throws MiniC_Universal_Exception.
+		 * on: each error is kept in `diagnostics()` and an `ERROR` token takes its place, the lexing goes on.
+		 */
+		struct Diagnostic
+		{
+			std::string _msg;
+			SourceLoc _loc;
+		};
+		void recover_errors(bool enable) { _recover = enable; }
+		const std::vector<Diagnostic>& diagnostics() const { return _diagnostics; }
+
+		/*
+		 * the names of the identifiers: by default the lexer has a table of its own, freed with the lexer and started again
+		 *     by each `tokenize()`, `stream()` and `tokenize_text()`, so an `identifier_of()` is valid until then;
+		 *     when the edits have doubled it, it is built again with the names of the tokens only (see `edit()`).
+		 * a table given to the constructor is shared, such as `util::symbols()` for `interpret::Env`, and only grows.
+		 */
+		Lexer();
+		explicit Lexer(util::Interner& names);
+		const util::Interner& names() const { return *_names; }
+
+		/*
+		 * editing: `tokenize_text()` lexes `text` as the file `name` and keeps it,
+		 *     then `edit()` replaces the chars `[begin, end)` of the kept text by `replacement`,
+		 *     lexes again only the lines the edit touches, and splices their tokens in,
+		 *     the tokens, the lines and the diagnostics after them are moved by the change in length.
+		 *     a lexical error throws before anything is changed, unless the errors are recovered.
+		 *     the pools of `tokens()` are compacted once the values of the replaced tokens outnumber the live ones,
+		 *     and an own table of names is built again once it is twice the size it had after the last build,
+		 *     so they do not grow over many edits, and a `Token` copied before an edit is not read after it.
+		 */
+		void tokenize_text(std::string text, const std::string& name);
+		void edit(std::size_t begin, std::size_t end, std::string_view replacement);
+		const std::string& text() const { return _edit_text; }
+		std::size_t offset_of(std::size_t line, std::size_t column) const { return line_start(line - 1) + column; }  // as `line_of()` and `pos_of()`
+
 		std::size_t size() const;
-		const Token& operator[](std::size_t pos) const { return _token_stream[pos]; }
+		Token operator[](std::size_t pos) const { return _token_stream[_front + pos]; }
 		bool empty() const;
+		const TokenStream& tokens() const { return _token_stream; }     // the popped tokens too, for their values
+
+		std::size_t line_of(SourceLoc loc) const;       // line number in the original file
+		std::size_t pos_of(SourceLoc loc) const;        // position in the line which is lexed
+		SourceLocation resolve(SourceLoc loc) const;    // O(log(macro expansions)), see `ExpansionMap`
+
 		Token getToken();       // only get, if no token, `throw MiniC_Universal_Exception`
 		void popToken();        // pop front, if no token, `throw MiniC_Universal_Exception`
 		Token consumeToken();   // consume, if no token, `throw MiniC_Universal_Exception`
 		void print(std::ostream& out) const;     // for DEBUG
-		Lexer() = default;
 		Lexer(const Lexer&) = delete;
 		Lexer& operator=(const Lexer&) = delete;
 	private:
-		std::deque<Token> _token_stream;
+		void reset();
+		void tokenize_line(const char* s, const std::size_t size, const std::size_t line_num, const std::size_t offset);
+		void tokenize_chunks(const char* text, std::size_t size, bool strip_cr, std::size_t threads);
+		bool refill();
+		std::size_t line_index(std::size_t offset) const;
+		std::size_t line_start(std::size_t index) const;
+		std::unique_ptr<util::Interner> _own_names; // null if the table is shared
+		util::Interner* _names;
+		std::size_t _names_built = 0;               // the size of the own table after it is last built
+		name_sink_t _line_names{ nullptr, {} };     // the symbols of the line lexed last by `tokenize_line()`
+		TokenStream _token_stream;
+		std::size_t _front = 0;                     // tokens before it are popped
+		std::vector<std::uint32_t> _line_starts;    // offset of each lexed line, of every `line_step`-th line when streaming
+		std::size_t _lines_lexed = 0;
+		preprocess::ExpandedSource _source_map;     // no `_text`, only the maps to the original file
+		const preprocess::ExpandedSource* _map = &_source_map;  // the streamed source, or `_source_map`
+		bool _recover = false;
+		std::vector<Diagnostic> _diagnostics;
+		bool _editing = false;
+		std::string _edit_text;                     // the text of `tokenize_text()`, with the edits
+		std::vector<std::uint32_t> _comment_lines;  // starts of the lines which begin in a block comment, for `edit()`
+		bool _in_comment = false;                   // the line lexed last ends in a block comment
+
+		// streaming
+		bool _streaming = false;
+		std::size_t _capacity = 0;
+		util::SourceBuffer _stream_file;
+		const char* _text = nullptr;                // the streamed text, to count the lines between the kept starts
+		std::size_t _text_size = 0;
+		std::size_t _next_line = 0;                 // offset of the next line to lex, `_text_size + 1` at the end
 		std::size_t cur_pos = 0;
 		std::size_t cur_line = 0;
 	};
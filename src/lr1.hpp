@@ -8363,7 +8363,7 @@ namespace Mini_C::LR1
 			{
 #ifdef OUTPUT_DFA
 				out << "SHIFT: [" << astack.top().condition << "->" << nextAction << "], \t";
-				output_token_t(t._token, out);
+				output_token_t(get_type(t), out);
 #endif // OUTPUT_DFA
 				astack.emplace((condition_of_analysis)nextAction, t);
 			}
@@ -8383,47 +8383,6 @@ namespace Mini_C::LR1
 
 	}; // end class SyntacticAnalyzer;
 
-	template <
-		typename T,
-		typename = std::enable_if_t<std::is_same_v<token_type,
-		std::remove_cv_t<std::remove_reference_t<decltype(std::declval<T>().operator[](0u))>>>
-		&& std::is_same_v<std::size_t, decltype(std::declval<T>().size())>>
-		> std::vector<std::pair<token_type, std::string>> analyze(const T& token_stream)
-	{
-		std::vector<std::pair<token_type, std::string>> error_result;
-		if (!token_stream.size()) return error_result;
-		SyntacticAnalyzer analyzer;
-		const std::size_t size = token_stream.size();
-		bool error_sequence = false; // denote whether there is error immediately before
-		for (size_t i = 0; i < size; i++)
-		{
-			bool error = false;
-			try {
-				out << "\n----------------------------------------------------------\n\n";
-				analyzer.analyze(token_stream[i]);
-			}
-			catch (const std::pair<token_type, std::string>& e) {
-				error = true;
-				if (!error_sequence) error_result.push_back(e);
-				error_sequence = true;
-			}
-			if (!error) error_sequence = false;
-		}
-		try {
-			out << "\n----------------------------------------------------------\n\n";
-			token_type __eof__ = token_type{
-				std::tuple<lexer::token_t, lexer::pos_t>
-				(lexer::type::__EOF__, token_stream[size - 1]._pos + 1),
-				token_stream[size - 1]._line
-			};
-			analyzer.analyze<true>(__eof__);
-		}
-		catch (const std::pair<token_type, std::string>& e) {
-			error_result.push_back(e);
-		}
-		return error_result;
-	} // end function std::vector<std::pair<token_type, std::string>> analyze();
-
 } // end namespace Mini_C::LR1;
 
 #endif // !RULE_H
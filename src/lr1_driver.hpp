@@ -0,0 +1,87 @@
+#ifndef LR1_DRIVER_H
+#define LR1_DRIVER_H
+#include "lr1.hpp"
+#include <utility>
+#include <vector>
+#include <string>
+#include <type_traits>
+
+/*
+ * the drivers of the `SyntacticAnalyzer` in lr1.hpp, which is the output of RulesTranslator and not edited by hand.
+ * `out` is defined before the include, as for lr1.hpp.
+ */
+namespace Mini_C::LR1
+{
+
+	/*
+	 * the tokens are pulled one by one, `token_source.next(t)` gives false after the last token (see `Lexer::stream()`).
+	 * an `ERROR` token is no terminal of the grammar, it is reported as a lexical error and not given to the analyzer.
+	 * of the errors in a row only the first is kept.
+	 */
+	template <
+		typename T,
+		typename = std::enable_if_t<std::is_same_v<bool, decltype(std::declval<T&>().next(std::declval<token_type&>()))>>
+		> std::vector<std::pair<token_type, std::string>> analyze_stream(T& token_source)
+	{
+		std::vector<std::pair<token_type, std::string>> error_result;
+		token_type t{ lexer::type::__EOF__, lexer::SourceLoc{ 0 } };
+		if (!token_source.next(t)) return error_result;
+		SyntacticAnalyzer analyzer;
+		bool error_sequence = false; // denote whether there is error immediately before
+		token_type last = t;
+		do
+		{
+			last = t;
+			bool error = false;
+			try {
+				out << "\n----------------------------------------------------------\n\n";
+				if (get_type(t) == lexer::type::ERROR)
+					throw std::pair<token_type, std::string>(t, "Lexical Error");
+				analyzer.analyze(t);
+			}
+			catch (const std::pair<token_type, std::string>& e) {
+				error = true;
+				if (!error_sequence) error_result.push_back(e);
+				error_sequence = true;
+			}
+			if (!error) error_sequence = false;
+		} while (token_source.next(t));
+		try {
+			out << "\n----------------------------------------------------------\n\n";
+			token_type __eof__ = token_type{
+				lexer::type::__EOF__,
+				lexer::SourceLoc{ last._loc._offset + 1 }
+			};
+			analyzer.analyze<true>(__eof__);
+		}
+		catch (const std::pair<token_type, std::string>& e) {
+			error_result.push_back(e);
+		}
+		return error_result;
+	} // end function std::vector<std::pair<token_type, std::string>> analyze_stream();
+
+	// every token of `token_stream` in order, as `analyze_stream()`
+	template <
+		typename T,
+		typename = std::enable_if_t<std::is_same_v<token_type,
+		std::remove_cv_t<std::remove_reference_t<decltype(std::declval<T>().operator[](0u))>>>
+		&& std::is_same_v<std::size_t, decltype(std::declval<T>().size())>>
+		> std::vector<std::pair<token_type, std::string>> analyze(const T& token_stream)
+	{
+		struct cursor_t
+		{
+			const T& _tokens;
+			std::size_t _next;
+			bool next(token_type& t)
+			{
+				if (_next == _tokens.size()) return false;
+				t = _tokens[_next++];
+				return true;
+			}
+		} cursor{ token_stream, 0 };
+		return analyze_stream(cursor);
+	} // end function std::vector<std::pair<token_type, std::string>> analyze();
+
+} // end namespace Mini_C::LR1;
+
+#endif // !LR1_DRIVER_H
@@ -1,14 +1,31 @@
 #include <iomanip>
 #include <fstream>
-#include <list>
+#include <cstdint>
+#include <cstring>
+#include <array>
 #include <deque>
+#include <algorithm>
+#include <vector>
 #include <unordered_map>
 #include <string_view>
-#include <cctype>
 #include <tuple>
-#include <functional>
-
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_set>
+#include <filesystem>
+#include <chrono>
+#include <exception>
+
+#include "preprocess.h"
 #include "miniC_exception.h"
+#include "lexer.h"
+#include "../util/source_buffer.h"
+#include "../util/char_class.h"
+#include "../util/simd_scan.h"
 
 
 namespace Mini_C::preprocess
@@ -22,634 +39,2250 @@ namespace Mini_C::preprocess
 		 *     line :
 		 *     pos  : from pos to detect identifier // pos <= sizes
 		 * Return
-		 *     identifier, pos after identifier
+		 *     identifier (viewed in `line`), pos after identifier
 		 *     if pos == -1, means no identifier !!!
 		 * No exception thrown
 		 */
-		[[nodiscard]] std::pair<std::string, int>
+		[[nodiscard]] std::pair<std::string_view, int>
 			get_identifier(std::string_view line, int pos, bool only_id = true) noexcept
 		{
+			using util::char_is;
+			namespace char_class = util::char_class;
 			const std::size_t size = line.size();
 			while (pos < size && line[pos] == ' ') pos++;
-			if (only_id)
-			{
-				if (pos == size || (!std::isalpha(line[pos]) && line[pos] != '_'))
-					return std::pair<std::string, int>({}, -1);
-			}
-			else {
-				if (pos == size || (!std::isalpha(line[pos]) && line[pos] != '_' && !std::isdigit(line[pos])))
-					return std::pair<std::string, int>({}, -1);
-			}
+			if (pos == size || !char_is(line[pos], only_id ? char_class::word_begin : char_class::word))
+				return std::pair<std::string_view, int>({}, -1);
 			int start = pos++;
 			for (; pos < size; pos++)
-				if (!std::isalpha(line[pos])
-					&& !std::isdigit(line[pos])
-					&& line[pos] != '_')
+				if (!char_is(line[pos], char_class::word))
 					break;
-			return std::pair<std::string, int>(line.substr(start, pos - start), pos);
+			return std::pair<std::string_view, int>(line.substr(start, pos - start), pos);
 		}
 
 
 		using arg_t = std::string;
-		using param_t = std::string;
+		using param_t = std::string_view;
+
+
+		/*
+		 * fields of a macro snapshot: 32-bit little-endian integers, and strings led by their size
+		 */
+		void put_u32(std::string& out, std::uint32_t value)
+		{
+			for (int i = 0; i < 4; i++)
+				out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+		}
 
-		class Macros
+		void put_str(std::string& out, std::string_view str)
 		{
+			put_u32(out, static_cast<std::uint32_t>(str.size()));
+			out.append(str);
+		}
 
+		// throw MiniC_Universal_Exception when the snapshot is broken
+		class SnapshotReader
+		{
 		public:
-			/*
-			* null     : #define x
-			* object   : #define xx ...
-			* function : #define foo(a, b) ...
-			*/
-			enum class macro_t { null, object, function };
+			explicit SnapshotReader(std::string_view data) :_data(data) {}
 
-		private:
-			class DefineBlock
+			std::uint32_t u32()
 			{
-			public:
-				DefineBlock(std::string macro, macro_t macro_type, std::size_t line_num)
-					:_macro(std::move(macro)), _macro_type(macro_type), _line_num(line_num) {}
+				need(4);
+				std::uint32_t value = 0;
+				for (int i = 0; i < 4; i++)
+					value |= static_cast<std::uint32_t>(static_cast<unsigned char>(_data[_pos + i])) << (8 * i);
+				_pos += 4;
+				return value;
+			}
 
-				// throw MiniC_Universal_Exception
-				void push_arg(arg_t arg, std::size_t pos)
-				{
-					for (auto const& _arg : _args)
-						if (_arg == arg)
-							throw MiniC_Universal_Exception(
-								std::string("\"") + arg + "\" has already appeared in the macro",
-								_line_num, pos);
-					_args.push_back(std::move(arg));
-				}
+			std::string_view bytes(std::size_t size)
+			{
+				need(size);
+				const std::string_view result = _data.substr(_pos, size);
+				_pos += size;
+				return result;
+			}
 
-				void push_replace(std::string replace) { _replace.push_back(std::move(replace)); }
+			std::string_view str() { return bytes(u32()); }
 
-				std::list<std::string> get_replace() const { return _replace; }
-				std::deque<arg_t> get_args() const { return _args; }
+			bool done() const { return _pos == _data.size(); }
+			std::size_t left() const { return _data.size() - _pos; }
 
-				// for debug
-				void print(std::ostream& out) const
-				{
-					out << "macro \"" << _macro << "\" in line " << _line_num << "\n";
-					if (!_args.empty())
-					{
-						out << "\targs:\n";
-						for (auto const& arg : _args)
-							out << "\t\t" << arg << std::endl;
-					}
-					if (!_replace.empty())
-					{
-						out << "\treplace:\n";
-						for (auto const& replace : _replace)
-							out << "\t\t" << replace << std::endl;
-					}
-					out << "------------------------------------------------\n";
-				}
+			[[noreturn]] void broken() const { throw MiniC_Universal_Exception{ "Broken macro snapshot", 0, _pos }; }
+
+		private:
+			void need(std::size_t size) const { if (_data.size() - _pos < size) broken(); }
+
+			std::string_view _data;
+			std::size_t _pos = 0;
+		};
 
-				const macro_t _macro_type;
-				const std::string _macro;
-				const std::size_t _line_num;
+		constexpr std::string_view snapshot_magic{ "MCM\x01", 4 };
+
+		// for the text which is not kept
+		struct no_trace
+		{
+			void enter(std::string_view, std::size_t, std::size_t) {}
+			void leave() {}
+		};
+
+	} // end anonymous namespace
 
-			private:
-				std::deque<arg_t> _args;
-				std::list<std::string> _replace;
-			}; // end class DefineBlock;
 
-			static std::unordered_map<std::string, DefineBlock> macros;
+	/*
+	 * the macro table of one `PreprocessContext`
+	 */
+	class Macros
+	{
 
+	public:
+		/*
+		* null     : #define x
+		* object   : #define xx ...
+		* function : #define foo(a, b) ...
+		*/
+		enum class macro_t { null, object, function };
+
+	private:
+		class DefineBlock
+		{
 		public:
+			DefineBlock(std::string macro, macro_t macro_type, std::size_t line_num)
+				:_macro(std::move(macro)), _macro_type(macro_type), _line_num(line_num) {}
 
-			// throw MiniC_Universal_Exception for macro collision
-			static void define_macro(const std::string& macro, macro_t macro_type, std::size_t line)
+			// throw MiniC_Universal_Exception
+			void push_arg(arg_t arg, std::size_t pos)
 			{
-				if (macros.count(macro))
-					throw MiniC_Universal_Exception(
-						std::string("The macro \"") + macro + "\" has already been defined",
-						line, 0);
-				macros.insert(
-					std::pair<const std::string, DefineBlock>
-					(macro, DefineBlock{ macro, macro_type, line }));
+				for (auto const& _arg : _args)
+					if (_arg == arg)
+						throw MiniC_Universal_Exception(
+							std::string("\"") + arg + "\" has already appeared in the macro",
+							_line_num, pos);
+				_args.push_back(std::move(arg));
 			}
 
-			// throw MiniC_Universal_Exception for undefining non macro
-			static void undef_macro(const std::string& macro, std::size_t line, std::size_t pos)
+			/*
+			 * compile one replace line when the macro is defined:
+			 * the line is split into text spans and the slots of args,
+			 * so that expansion only splices spans, and never scans the line again.
+			 */
+			void push_replace(std::string_view replace)
 			{
-				auto it = macros.find(macro);
-				if (it == macros.end())
-					throw MiniC_Universal_Exception(
-						std::string("The macro \"") + macro + "\" has not been defined yet",
-						line, pos);
-				macros.erase(it);
+				const std::size_t base = _body.size();
+				_body.append(replace);
+				_body.push_back('\n');
+				_line_count++;
+
+				const int size = replace.size();
+				int start = 0, pos = 0;
+				std::pair<std::string_view, int> p;
+				while (pos < size)
+				{
+					while (pos < size && replace[pos] == ' ') pos++;
+					p = get_identifier(replace, pos);
+					if (p.second == -1)
+					{
+						pos++;
+						continue;
+					}
+
+					const int slot = arg_slot(p.first);
+					if (slot == text)
+					{
+						pos = p.second;
+						continue;
+					}
+
+					push_piece(base + start, pos - start, text);
+					push_piece(0, 0, slot);
+					start = pos = p.second;
+				}
+				push_piece(base + start, std::min(pos, size) - start, text);
+				push_piece(_body.size() - 1, 0, new_line);
 			}
 
-			// throw MiniC_Universal_Exception for arg collision
-			static void push_arg(const std::string& macro, std::string arg, std::size_t pos)
+			std::size_t args_size() const { return _args.size(); }
+
+			/*
+			 * splice the replace lines, with `params[i]` for the i-th arg
+			 * the cost is in proportion to the size of the result
+			 * `params.size()` must be `args_size()`
+			 * push the view of each replace line into `lines`,
+			 *     lines of "macro_t::object" are viewed in the macro itself,
+			 *     lines of "macro_t::function" are spliced into a new string in `arena`.
+			 */
+			void expand(const std::vector<param_t>& params, std::deque<std::string>& arena,
+				std::vector<std::string_view>& lines) const
 			{
-				auto pBlock = macros.find(macro);
-				pBlock->second.push_arg(std::move(arg), pos);
+				if (_macro_type != macro_t::function)
+				{
+					std::size_t begin = 0;
+					for (piece_t const& piece : _pieces)
+						if (piece._slot == new_line)
+						{
+							lines.push_back(std::string_view(_body).substr(begin, piece._begin - begin));
+							begin = piece._begin + 1;
+						}
+					return;
+				}
+
+				// reserve first, so the views are not invalidated while splicing
+				std::size_t total = 0;
+				for (piece_t const& piece : _pieces)
+					total += piece._slot >= 0 ? params[piece._slot].size() : piece._size;
+				std::string& line_str = arena.emplace_back();
+				line_str.reserve(total);
+				std::size_t begin = 0;
+				for (piece_t const& piece : _pieces)
+				{
+					if (piece._slot == text)
+						line_str.append(_body, piece._begin, piece._size);
+					else if (piece._slot == new_line)
+					{
+						lines.push_back(std::string_view(line_str.data() + begin, line_str.size() - begin));
+						begin = line_str.size();
+					}
+					else line_str.append(params[piece._slot]);
+				}
 			}
 
-			static void push_replace(const std::string& macro, std::string replace)
+			// the compiled block as it is, see `Macros::save()`
+			void save(std::string& out) const
 			{
-				macros.find(macro)->second.push_replace(std::move(replace));
+				put_str(out, _macro);
+				put_u32(out, static_cast<std::uint32_t>(_macro_type));
+				put_u32(out, static_cast<std::uint32_t>(_line_num));
+				put_u32(out, static_cast<std::uint32_t>(_args.size()));
+				for (auto const& arg : _args)
+					put_str(out, arg);
+				put_str(out, _body);
+				put_u32(out, static_cast<std::uint32_t>(_line_count));
+				put_u32(out, static_cast<std::uint32_t>(_pieces.size()));
+				for (piece_t const& piece : _pieces)
+				{
+					put_u32(out, piece._begin);
+					put_u32(out, piece._size);
+					put_u32(out, static_cast<std::uint32_t>(piece._slot));
+				}
 			}
 
-			// make replacement for one line
-			// throw MiniC_Universal_Exception if macro format does not meet
-			// return (line_str, line_num, change_line)
-			static std::list<std::tuple<std::string, std::size_t, bool>>
-				replace(std::string_view line, const std::size_t line_num, bool change_line)
+			/*
+			 * the pieces are checked as a whole, so that `expand()` stays in `_body` and `params`:
+			 * the text pieces and the line ends are in the order of `_body` and do not overlap,
+			 * and each line end is at a '\n' of `_body`.
+			 */
+			static DefineBlock load(SnapshotReader& in)
 			{
-				const std::size_t size = line.size();
-				std::size_t pos = 0;
-				std::list<std::tuple<std::string, std::size_t, bool>> ret;
-
-				// throw MiniC_Universal_Exception if macro format does not meet 
-				std::function<void(const std::string&, std::size_t)> replace_macro
-					= [&replace_macro, &ret, size, line, line_num]
-					(const std::string& macro, std::size_t pos)->void
+				std::string macro{ in.str() };
+				const std::uint32_t macro_type = in.u32();
+				if (macro.empty() || macro_type > static_cast<std::uint32_t>(macro_t::function)) in.broken();
+				DefineBlock block{ std::move(macro), static_cast<macro_t>(macro_type), in.u32() };
+				for (std::uint32_t i = in.u32(); i > 0; i--)
+					block._args.emplace_back(in.str());
+				block._body = in.str();
+				block._line_count = in.u32();
+
+				std::size_t lines = 0, next = 0; // `next`: where the next text piece or line end may begin
+				const std::uint32_t pieces = in.u32();
+				block._pieces.reserve(std::min<std::size_t>(pieces, in.left() / 12)); // a piece takes 12 bytes
+				for (std::uint32_t i = 0; i < pieces; i++)
 				{
-					pos += macro.size();
-					auto const pb = macros.find(macro);
-					const DefineBlock& block = pb->second;
-
-					if (block._macro_type == macro_t::null)
-						throw MiniC_Universal_Exception(
-							"Expected something for macro \"" + block._macro + "\"",
-							line_num, pos);
-
-					if (block._macro_type == macro_t::object)
+					piece_t piece{ in.u32(), in.u32(), 0 };
+					piece._slot = static_cast<int>(in.u32());
+					if (piece._slot >= static_cast<int>(block._args.size()) || piece._slot < new_line
+						|| piece._begin > block._body.size() || piece._size > block._body.size() - piece._begin)
+						in.broken();
+					if (piece._slot == new_line)
+					{
+						if (piece._begin < next || piece._begin == block._body.size() || block._body[piece._begin] != '\n') in.broken();
+						next = piece._begin + 1;
+						lines++;
+					}
+					else if (piece._slot == text)
 					{
-						const std::list<std::string> replaces = block.get_replace();
-						for (auto it = replaces.begin(); it != replaces.end(); ++it)
-							ret.push_back(std::make_tuple(*it, line_num, true));
-						std::get<2>(ret.back()) = false;
-					} // end replace "macro_t::object"
+						if (piece._begin < next) in.broken();
+						next = piece._begin + piece._size;
+					}
+					block._pieces.push_back(piece);
+				}
+				if (lines != block._line_count) in.broken();
+				return block;
+			}
 
-					else if (block._macro_type == macro_t::function)
+			// for debug
+			void print(std::ostream& out) const
+			{
+				out << "macro \"" << _macro << "\" in line " << _line_num << "\n";
+				if (!_args.empty())
+				{
+					out << "\targs:\n";
+					for (auto const& arg : _args)
+						out << "\t\t" << arg << std::endl;
+				}
+				if (_line_count != 0)
+				{
+					out << "\treplace:\n";
+					for (std::size_t begin = 0, end; begin < _body.size(); begin = end + 1)
 					{
-						// "foo()" or "foo(a, b, c)"
-						std::deque<param_t> params;
-						std::pair<std::string, int> p;
-
-						if (line[pos] != '(')
-							throw MiniC_Universal_Exception(
-								"Expected \"(\" after macro \"" + block._macro + "\"",
-								line_num, pos);
-						pos++;
+						end = _body.find('\n', begin);
+						out << "\t\t" << std::string_view(_body).substr(begin, end - begin) << std::endl;
+					}
+				}
+				out << "------------------------------------------------\n";
+			}
 
-						const std::deque<std::string> args = block.get_args();
-						const std::size_t args_size = args.size();
+			const macro_t _macro_type;
+			const std::string _macro;
+			const std::size_t _line_num;
+			bool _hidden = false; // in the hide-set of the text being scanned
 
-						// detect "foo()"
-						if (pos == size)
-						{
-							if (args_size == 0)
-								throw MiniC_Universal_Exception{
-								"Expected \")\" for macro \"" + macro + "\"",
-								line_num, static_cast<std::size_t>(pos) };
-							else throw MiniC_Universal_Exception{
-								"Expected " + std::to_string(args_size)
-								+ " parameters for macro \"" + macro + "\"",
-								line_num, static_cast<std::size_t>(pos) };
-						}
+		private:
+			/*
+			 * _slot >= 0        : the `_slot`-th arg
+			 * _slot == text     : `_body.substr(_begin, _size)`
+			 * _slot == new_line : the end of one replace line
+			 */
+			struct piece_t
+			{
+				std::uint32_t _begin;
+				std::uint32_t _size;
+				int _slot;
+			};
+			static constexpr int text = -1;
+			static constexpr int new_line = -2;
+
+			int arg_slot(std::string_view id) const
+			{
+				for (std::size_t i = 0; i < _args.size(); i++)
+					if (_args[i] == id)
+						return static_cast<int>(i);
+				return text;
+			}
 
-						int _case = 0;
-						if (line[pos] == ')')
-						{
-							_case = 2;
-							pos++;
-						}
-						if (_case == 0)
-						{
-							p = get_identifier(line, pos, false);
-							if (p.second == -1)
-								throw MiniC_Universal_Exception{
-								"Incorrect format in macro \"" + macro + "\"",
-								line_num, static_cast<std::size_t>(pos) };
-							pos = p.second;
-							params.push_back(p.first);
-						}
+			void push_piece(std::size_t begin, std::size_t size, int slot)
+			{
+				if (slot == text && size == 0) return;
+				_pieces.push_back(piece_t{ static_cast<std::uint32_t>(begin), static_cast<std::uint32_t>(size), slot });
+			}
 
+			std::vector<arg_t> _args;
+			std::string _body;             // replace lines, each one ends with '\n'
+			std::vector<piece_t> _pieces;  // compiled `_body`
+			std::size_t _line_count = 0;
+		}; // end class DefineBlock;
 
-						// case   -> id -> case 0
-						// detect: *(, id) ")" or 
-						// case 0 -> ,  -> case 1
-						// case 1 -> id -> case 0
-						// case 0 -> )  -> case 2 -> ok
-						//          ,  id   )
-						// case0:   1, -1,  2 
-						// case1:  -1,  0, -1
-						std::size_t prev_pos = 0;
-						auto throw_ex_case_0 = [line, args_size, &params, macro, line_num, &prev_pos]()->void
-						{
-							const int size_diff = static_cast<int>(args_size)
-								- static_cast<int>(params.size());
-
-							if (size_diff > 0)
-								throw MiniC_Universal_Exception{
-										"Expected \",\" and "
-										+ std::to_string(size_diff)
-										+ " more parameters in function-macro \""
-										+ macro + "\"",
-										line_num, static_cast<std::size_t>(prev_pos + params.back().size()) };
-							else if (size_diff == 0)
-								throw MiniC_Universal_Exception{
-										"Expected \")\" after function-macro \""
-										+ macro + "\"",
-										line_num, static_cast<std::size_t>(prev_pos + params.back().size()) };
-							else // size_diff < 0
-								throw MiniC_Universal_Exception{
-										"Expected "
-										+ std::to_string(args_size)
-										+ " parameters but given "
-										+ std::to_string(params.size())
-										+ " in function-macro \""
-										+ macro + "\"",
-										line_num, static_cast<std::size_t>(prev_pos + params.back().size()) };
-						};
-						auto throw_ex_case_1 = [line, args_size, &params, macro, line_num, &prev_pos]()->void
-						{
-							const int size_diff = static_cast<int>(args_size)
-								- static_cast<int>(params.size());
-
-							if (size_diff > 0)
-								throw MiniC_Universal_Exception{
-										"Expected "
-										+ std::to_string(size_diff)
-										+ " more parameters in function-macro \""
-										+ macro + "\" after \",\"",
-										line_num, static_cast<std::size_t>(prev_pos + 1) };
-							else if (size_diff == 0)
-								throw MiniC_Universal_Exception{
-										"Unexpected \",\" in function-macro \""
-										+ macro + "\" but expect \")\"",
-										line_num, static_cast<std::size_t>(prev_pos) };
-							else // size_diff < 0
-								throw MiniC_Universal_Exception{
-										"Unexpected \",\" and "
-										+ std::to_string(args_size)
-										+ " parameters but given "
-										+ std::to_string(params.size())
-										+ " in function-macro \""
-										+ macro + "\"",
-										line_num, static_cast<std::size_t>(prev_pos) };
-						};
-						while (_case != 2)
-						{
-							while (pos < size && line[pos] == ' ') pos++;
-							if (pos == size)
-							{
-								if (_case == 0)
-									throw_ex_case_0();
-								else // _case == 1
-									throw_ex_case_1();
-							}
+		std::unordered_map<std::string, DefineBlock> macros;
 
-							if (_case == 0)
-							{
-								// case 0 -> )  -> case 2 -> ok
-								if (line[pos] == ')' && _case == 0)
-								{
-									pos++;
-									break;
-								}
+		/*
+		 * filter before looking up `macros`, without hashing or allocating.
+		 *     bit `n` of `_filter[c]` : some macro begins with `c` and has `n` chars
+		 *                               (all macros longer than 63 share bit 63).
+		 * An identifier failing the filter is not a macro.
+		 */
+		std::array<std::uint64_t, 128> _filter = {};
+		bool _filter_dirty = false;
+		std::string _key; // reused to look up `macros`
 
-								// case 0 -> ,  -> case 1
-								if (line[pos] == ',' && _case == 0)
-								{
-									prev_pos = pos;
-									_case = 1;
-									continue;
-								}
+		static std::uint64_t filter_bit(std::size_t size) { return std::uint64_t(1) << std::min<std::size_t>(size, 63); }
+		void add_filter(std::string_view macro) { _filter[macro[0] & 0x7F] |= filter_bit(macro.size()); }
+		bool may_be_macro(std::string_view id) const { return (_filter[id[0] & 0x7F] & filter_bit(id.size())) != 0; }
 
-								throw_ex_case_0();
-							}
+		// text to scan for `replace()`
+		struct frame_t
+		{
+			std::string_view _text;
+			bool _change_line;
+			DefineBlock* _unhide; // not null: the end of the text expanded from `_unhide`
+		};
 
-							// case 1 -> id -> case 0
-							p = get_identifier(line, pos + 1, false);
-							if (p.second == -1)
-								throw_ex_case_1();
-							prev_pos = pos + 1;
-							pos = p.second;
-							params.push_back(p.first);
-							_case = 0;
+		/*
+		 * whole expansion of an outermost function macro, for the same params it is replayed,
+		 * instead of being spliced and scanned again.
+		 *     _generation : of the macro table when it is recorded, an older one is out of date
+		 *     _ops        : the text emitted, and the nested expansions for the trace
+		 *     _replayed   : since the clock hand last passed, see `record()`
+		 */
+		struct cached_t
+		{
+			enum class op_kind : std::uint8_t { text, enter, leave };
+			struct op_t
+			{
+				op_kind _kind;
+				const std::string* _macro;    // `enter`
+				std::uint32_t _begin, _size;  // `text`, in `_text`
+				bool _change_line;            // `text`
+			};
+
+			std::uint64_t _generation = ~std::uint64_t(0);
+			std::string _text;
+			std::vector<op_t> _ops;
+			bool _replayed = false;
+		};
+
+		using cache_t = std::unordered_map<std::string, cached_t>;
+		static constexpr std::size_t max_cached = 4096;
+		cache_t _cache; // "macro\0param\0param..." -> expansion
+		std::string _cache_key;
+		std::vector<cache_t::value_type*> _clock; // the entries of `_cache` in a ring
+		std::size_t _clock_hand = 0;
 
-						} // end while-loop for detecting function macro
+		/*
+		 * the entry to record the expansion of `_cache_key` into, `stale` if it is not `_cache.end()`.
+		 * when the cache is full, the clock hand skips the entries replayed since it last passed (and clears their mark),
+		 * the first other one is evicted: its node and its buffers take the new expansion, nothing is allocated.
+		 */
+		cached_t& record(cache_t::iterator stale)
+		{
+			cached_t* entry = nullptr;
+			if (stale != _cache.end())
+				entry = &stale->second;
+			else if (_cache.size() < max_cached)
+			{
+				cache_t::value_type& inserted = *_cache.try_emplace(_cache_key).first;
+				_clock.push_back(&inserted);
+				entry = &inserted.second;
+			}
+			else
+			{
+				for (; _clock[_clock_hand]->second._replayed; _clock_hand = (_clock_hand + 1) % _clock.size())
+					_clock[_clock_hand]->second._replayed = false;
+				cache_t::node_type node = _cache.extract(_clock[_clock_hand]->first);
+				node.key().assign(_cache_key);
+				_clock[_clock_hand] = &*_cache.insert(std::move(node)).position;
+				entry = &_clock[_clock_hand]->second;
+				_clock_hand = (_clock_hand + 1) % _clock.size();
+			}
+			entry->_generation = ~std::uint64_t(0);
+			entry->_text.clear();
+			entry->_ops.clear();
+			entry->_replayed = false;
+			return *entry;
+		}
+		std::uint64_t _generation = 0; // bumped when the macro table is changed
 
+		template<typename Emit, typename Trace>
+		static void replay(const cached_t& cached, std::size_t line_num, Emit&& emit, Trace&& trace)
+		{
+			for (cached_t::op_t const& op : cached._ops)
+				if (op._kind == cached_t::op_kind::text)
+					emit(std::string_view(cached._text).substr(op._begin, op._size), line_num, op._change_line);
+				else if (op._kind == cached_t::op_kind::enter)
+					trace.enter(*op._macro, 0, 0);
+				else trace.leave();
+		}
 
-						if (params.size() != args_size)
-							throw MiniC_Universal_Exception(
-								"Expected " + std::to_string(args_size)
-								+ " parmeters for macro \"" + block._macro + "\" but given "
-								+ std::to_string(params.size()),
-								line_num, pos);
+		// buffers reused by `replace()`
+		std::vector<frame_t> _stack;
+		std::deque<std::string> _arena;
+		std::vector<param_t> _params;
+		std::vector<std::string_view> _lines;
 
-						/*
-						 * replace macro lines
-						 */
+	public:
 
-						std::unordered_map<arg_t, param_t> replace_map;
-						for (int i = 0; i < args_size; i++)
-							replace_map.insert(std::make_pair(args[i], params[i]));
+		// throw MiniC_Universal_Exception for macro collision
+		void define_macro(const std::string& macro, macro_t macro_type, std::size_t line)
+		{
+			if (macros.count(macro))
+				throw MiniC_Universal_Exception(
+					std::string("The macro \"") + macro + "\" has already been defined",
+					line, 0);
+			macros.insert(
+				std::pair<const std::string, DefineBlock>
+				(macro, DefineBlock{ macro, macro_type, line }));
+			add_filter(macro);
+			_generation++;
+		}
 
-						const std::list<std::string> replaces = block.get_replace();
+		// throw MiniC_Universal_Exception for undefining non macro
+		void undef_macro(const std::string& macro, std::size_t line, std::size_t pos)
+		{
+			auto it = macros.find(macro);
+			if (it == macros.end())
+				throw MiniC_Universal_Exception(
+					std::string("The macro \"") + macro + "\" has not been defined yet",
+					line, pos);
+			macros.erase(it);
+			_filter_dirty = true; // rebuilt before the next scan
+			_generation++;
+		}
 
-						auto replace_macro_line =
-							[&replace_map](std::string_view macro_line)->std::string
-						{
-							std::string replace;
-							std::pair<std::string, int> p;
-							const int size = macro_line.size();
-							int start = 0, pos = 0;
-							while (pos < size)
-							{
-								while (pos < size && macro_line[pos] == ' ') pos++;
-								p = get_identifier(macro_line, pos);
+		// throw MiniC_Universal_Exception for arg collision
+		void push_arg(const std::string& macro, std::string arg, std::size_t pos)
+		{
+			auto pBlock = macros.find(macro);
+			pBlock->second.push_arg(std::move(arg), pos);
+		}
 
-								if (p.second == -1)
-								{
-									pos++;
-									continue;
-								}
+		void push_replace(const std::string& macro, std::string_view replace)
+		{
+			macros.find(macro)->second.push_replace(replace);
+		}
 
-								auto it = replace_map.find(p.first);
-								if (it == replace_map.end())
-								{
-									pos += p.first.size();
-									continue;
-								}
+		/*
+		 * parse the params of "foo(a, b, c)"
+		 *     `pos` is just after "foo", params are viewed in `line`
+		 * return the pos after ")"
+		 * throw MiniC_Universal_Exception if macro format does not meet
+		 */
+		static std::size_t parse_params(std::string_view line, std::size_t pos, const DefineBlock& block,
+			const std::size_t line_num, std::vector<param_t>& params)
+		{
+			// "foo()" or "foo(a, b, c)"
+			const std::size_t size = line.size();
+			const std::string& macro = block._macro;
+			std::pair<std::string_view, int> p;
 
-								replace.append(std::string(
-									macro_line.substr(start, pos - start)));
-								replace.append(it->second);
-								start = pos = p.second;
-							}
-							replace.append(std::string(macro_line.substr(start, pos - start)));
-							return replace;
-						}; // end lambda replace_macro_line();
+			if (pos == size || line[pos] != '(')
+				throw MiniC_Universal_Exception(
+					"Expected \"(\" after macro \"" + block._macro + "\"",
+					line_num, pos);
+			pos++;
+
+			const std::size_t args_size = block.args_size();
+			params.reserve(args_size);
 
-						for (auto it = replaces.begin(); it != replaces.end(); ++it)
-							ret.push_back(std::make_tuple(
-								replace_macro_line(*it), line_num, true));
-						std::get<2>(ret.back()) = false;
+			// detect "foo()"
+			if (pos == size)
+			{
+				if (args_size == 0)
+					throw MiniC_Universal_Exception{
+					"Expected \")\" for macro \"" + macro + "\"",
+					line_num, static_cast<std::size_t>(pos) };
+				else throw MiniC_Universal_Exception{
+					"Expected " + std::to_string(args_size)
+					+ " parameters for macro \"" + macro + "\"",
+					line_num, static_cast<std::size_t>(pos) };
+			}
 
-					} // end replace "macro_t::function"
+			int _case = 0;
+			if (line[pos] == ')')
+			{
+				_case = 2;
+				pos++;
+			}
+			if (_case == 0)
+			{
+				p = get_identifier(line, pos, false);
+				if (p.second == -1)
+					throw MiniC_Universal_Exception{
+					"Incorrect format in macro \"" + macro + "\"",
+					line_num, static_cast<std::size_t>(pos) };
+				pos = p.second;
+				params.push_back(p.first);
+			}
 
-				}; // end std::function replace_macro();
 
-				std::pair<std::string, int> p;
-				std::size_t start = 0;
-				while (pos < size)
+			// case   -> id -> case 0
+			// detect: *(, id) ")" or 
+			// case 0 -> ,  -> case 1
+			// case 1 -> id -> case 0
+			// case 0 -> )  -> case 2 -> ok
+			//          ,  id   )
+			// case0:   1, -1,  2 
+			// case1:  -1,  0, -1
+			std::size_t prev_pos = 0;
+			auto throw_ex_case_0 = [line, args_size, &params, macro, line_num, &prev_pos]()->void
+			{
+				const int size_diff = static_cast<int>(args_size)
+					- static_cast<int>(params.size());
+
+				if (size_diff > 0)
+					throw MiniC_Universal_Exception{
+							"Expected \",\" and "
+							+ std::to_string(size_diff)
+							+ " more parameters in function-macro \""
+							+ macro + "\"",
+							line_num, static_cast<std::size_t>(prev_pos + params.back().size()) };
+				else if (size_diff == 0)
+					throw MiniC_Universal_Exception{
+							"Expected \")\" after function-macro \""
+							+ macro + "\"",
+							line_num, static_cast<std::size_t>(prev_pos + params.back().size()) };
+				else // size_diff < 0
+					throw MiniC_Universal_Exception{
+							"Expected "
+							+ std::to_string(args_size)
+							+ " parameters but given "
+							+ std::to_string(params.size())
+							+ " in function-macro \""
+							+ macro + "\"",
+							line_num, static_cast<std::size_t>(prev_pos + params.back().size()) };
+			};
+			auto throw_ex_case_1 = [line, args_size, &params, macro, line_num, &prev_pos]()->void
+			{
+				const int size_diff = static_cast<int>(args_size)
+					- static_cast<int>(params.size());
+
+				if (size_diff > 0)
+					throw MiniC_Universal_Exception{
+							"Expected "
+							+ std::to_string(size_diff)
+							+ " more parameters in function-macro \""
+							+ macro + "\" after \",\"",
+							line_num, static_cast<std::size_t>(prev_pos + 1) };
+				else if (size_diff == 0)
+					throw MiniC_Universal_Exception{
+							"Unexpected \",\" in function-macro \""
+							+ macro + "\" but expect \")\"",
+							line_num, static_cast<std::size_t>(prev_pos) };
+				else // size_diff < 0
+					throw MiniC_Universal_Exception{
+							"Unexpected \",\" and "
+							+ std::to_string(args_size)
+							+ " parameters but given "
+							+ std::to_string(params.size())
+							+ " in function-macro \""
+							+ macro + "\"",
+							line_num, static_cast<std::size_t>(prev_pos) };
+			};
+			while (_case != 2)
+			{
+				while (pos < size && line[pos] == ' ') pos++;
+				if (pos == size)
 				{
-					while (pos < size && line[pos] == ' ') pos++;
-					p = get_identifier(line, pos);
-					if (p.second == -1)
+					if (_case == 0)
+						throw_ex_case_0();
+					else // _case == 1
+						throw_ex_case_1();
+				}
+
+				if (_case == 0)
+				{
+					// case 0 -> )  -> case 2 -> ok
+					if (line[pos] == ')' && _case == 0)
 					{
 						pos++;
-						continue;
+						break;
 					}
-					if (macros.find(p.first) == macros.end()) pos = p.second;
-					else // replace "foo(2, 3)"
+
+					// case 0 -> ,  -> case 1
+					if (line[pos] == ',' && _case == 0)
 					{
-						ret.push_back(std::make_tuple(
-							std::string(line.substr(start, pos - start)), line_num, false));
-						replace_macro(p.first, pos); // throw MiniC_Universal_Exception
-													 // perpare the "pos" and "start"
-						{
-							auto const pb = macros.find(p.first);
-							const DefineBlock& block = pb->second;
-							if (block._macro_type == macro_t::function)
-							{
-								// jump over the ")" in "foo(2, 3)"
-								while (line[pos] != ')') pos++;
-								start = ++pos;
-							}
-							else // "macro_t::function"
-								start = pos = p.second;
-						}
+						prev_pos = pos;
+						_case = 1;
+						continue;
 					}
-				}
-				ret.push_back(std::make_tuple(
-					std::string(line.substr(start, pos - start)), line_num, change_line));
-				return ret;
-			} // end function replace();
 
-			// for debug
-			static void print(std::ostream& out)
-			{
-				for (auto const&[s, b] : macros)
-					b.print(out);
-			}
+					throw_ex_case_0();
+				}
 
-		}; // end class Macros;
+				// case 1 -> id -> case 0
+				p = get_identifier(line, pos + 1, false);
+				if (p.second == -1)
+					throw_ex_case_1();
+				prev_pos = pos + 1;
+				pos = p.second;
+				params.push_back(p.first);
+				_case = 0;
 
+			} // end while-loop for detecting function macro
 
-	} // end anonymous namespace
-	std::unordered_map<std::string, Macros::DefineBlock> Macros::macros = {};
 
+			if (params.size() != args_size)
+				throw MiniC_Universal_Exception(
+					"Expected " + std::to_string(args_size)
+					+ " parmeters for macro \"" + block._macro + "\" but given "
+					+ std::to_string(params.size()),
+					line_num, pos);
 
-	/*
-	 * return a new file which makes the replacement of macros
-	 */
-	[[nodiscard]] const std::string preprocess(const std::string& file_name, std::ostream& out)
-	{
-		constexpr std::size_t MAXSIZE = 256;
-		char buffer[MAXSIZE];
-		std::ifstream inputFile{ file_name, std::ios::in };
-		if (!inputFile.is_open()) {
-			std::cout << "failed to open: " << std::quoted(file_name) << std::endl;
-			exit(0);
-		}
 
-		// (line_str, line_num, change_line)
-		std::list<std::tuple<std::string, std::size_t, bool>> lines;
-		std::size_t line_num = 0;
-		while (!inputFile.eof())
-		{
-			line_num++;
-			inputFile.getline(buffer, MAXSIZE - 1);
-			lines.push_back(std::make_tuple(std::string(buffer), line_num, true));
-		}
-		std::get<2>(lines.back()) = false;
-		inputFile.close();
+			return pos;
+		} // end function parse_params();
 
 
-		line_num = 1;
-		for (auto it = lines.begin(); it != lines.end(); )
+		/*
+		 * make replacement for one line, and emit (line_str, line_num, change_line)
+		 *
+		 * The expanded text is scanned again for macros before the rest of the line.
+		 * Instead of recursion, the text still to scan is kept in an explicit stack.
+		 * While the text expanded from a macro is being scanned, the macro is hidden
+		 * (the hide-set of the text), so "#define A A" expands only once,
+		 * and the nesting depth is limited by `max_depth`.
+		 * `trace.enter(macro, column, size)` and `trace.leave()` enclose the text expanded from a macro,
+		 * `column` and `size` locate the replaced text in `line` for the outermost macros, or 0.
+		 *
+		 * throw MiniC_Universal_Exception if macro format does not meet
+		 */
+		template<typename Emit, typename Trace>
+		void replace(std::string_view line, const std::size_t line_num, bool change_line, Emit&& emit, Trace&& trace)
 		{
-			std::string_view line = std::get<0>(*it);
-			line_num = std::get<1>(*it);
-			std::size_t size = line.size();
-
-			// `#define` must be at the start of one line
-			if (line._Starts_with("#define "))
+			// most lines meet no macro at all
+			if (macros.empty())
 			{
-				std::pair<std::string, int> p;
-				p = get_identifier(line, 8);
-				int pos = p.second;
-				if (pos == -1)
-					throw MiniC_Universal_Exception{ "Expected identifier after \"#define\"", line_num, 8 };
-				const std::string macro{ p.first };
+				emit(line, line_num, change_line);
+				return;
+			}
 
-				while (pos < size && line[pos] == ' ') pos++;
+			if (_filter_dirty)
+			{
+				_filter.fill(0);
+				for (auto const&[s, b] : macros)
+					add_filter(s);
+				_filter_dirty = false;
+			}
 
-				try {
+			std::vector<frame_t>& stack = _stack;
+			std::size_t depth = 0;
+			stack.clear();
+			_arena.clear();
+			stack.push_back(frame_t{ line, change_line, nullptr });
 
-					// "#define xxx"
-					if (pos == size)
+			// the expansion of the outermost function macro is recorded, while `recording` is not null
+			cached_t* recording = nullptr;
+			auto output = [&](std::string_view text, bool change_line)
+			{
+				emit(text, line_num, change_line);
+				if (recording == nullptr || depth == 0) return;
+				recording->_ops.push_back(cached_t::op_t{ cached_t::op_kind::text, nullptr,
+					static_cast<std::uint32_t>(recording->_text.size()), static_cast<std::uint32_t>(text.size()), change_line });
+				recording->_text.append(text);
+			};
+
+			try {
+				while (!stack.empty())
+				{
+					const frame_t frame = stack.back();
+					stack.pop_back();
+					if (frame._unhide)
 					{
-						Macros::define_macro(macro, Macros::macro_t::null, line_num);
-						it = lines.erase(it); // erase this line
+						frame._unhide->_hidden = false;
+						depth--;
+						trace.leave();
+						if (recording && depth == 0)
+						{
+							recording->_generation = _generation;
+							recording = nullptr;
+						}
+						else if (recording)
+							recording->_ops.push_back(cached_t::op_t{ cached_t::op_kind::leave, nullptr, 0, 0, false });
 						continue;
 					}
 
-					// "#define foo(...)"
-					if (line[pos] == '(')
+					const std::string_view text = frame._text;
+					const std::size_t size = text.size();
+					std::size_t pos = 0;
+					std::pair<std::string_view, int> p;
+					DefineBlock* block = nullptr;
+					while (pos < size)
 					{
-						Macros::define_macro(macro, Macros::macro_t::function, line_num);
-
-						pos++;
-						// detect "foo()"
-						if (pos == size)
-							throw MiniC_Universal_Exception{
-							"Expected something for macro \"" + macro + "\"",
-							line_num, static_cast<std::size_t>(pos) };
-
-						int _case = 0;
-						if (line[pos] == ')')
+						while (pos < size && text[pos] == ' ') pos++;
+						p = get_identifier(text, pos);
+						if (p.second == -1)
 						{
-							_case = 2;
 							pos++;
+							continue;
 						}
-						if (_case == 0)
+						if (!may_be_macro(p.first))
 						{
-							p = get_identifier(line, pos);
-							if (p.second == -1)
-								throw MiniC_Universal_Exception{
-								"Incorrect format in macro \"" + macro + "\"",
-								line_num, static_cast<std::size_t>(pos) };
 							pos = p.second;
-							Macros::push_arg(macro, p.first, pos - p.first.size());
+							continue;
 						}
-						// case   -> (  -> case 0
-						// detect: *(, id) ")"
-						// case 0 -> ,  -> case 1
-						// case 1 -> id -> case 0
-						// case 0 -> )  -> case 2 -> ok
-						//          ,  id   )
-						// case0:   1, -1,  2 
-						// case1:  -1,  0, -1
-						while (_case != 2)
+						_key.assign(p.first.data(), p.first.size());
+						auto const pb = macros.find(_key);
+						if (pb == macros.end() || pb->second._hidden) pos = p.second;
+						else // replace "foo(2, 3)"
 						{
-							while (pos < size && line[pos] == ' ') pos++;
-							if (pos == size)
-								throw MiniC_Universal_Exception{
-								"Incorrect format in macro \"" + macro + "\"",
-								line_num, static_cast<std::size_t>(pos) };
-
-							if (_case == 0)
-							{
-								// case 0 -> )  -> case 2 -> ok
-								if (line[pos] == ')' && _case == 0)
-								{
-									pos++;
-									break;
-								}
-
-								// case 0 -> ,  -> case 1
-								if (line[pos] == ',' && _case == 0)
-								{
-									_case = 1;
-									continue;
-								}
-
-								throw MiniC_Universal_Exception{
-									"Incorrect format in macro \"" + macro + "\"",
-									line_num, static_cast<std::size_t>(pos) };
-							}
+							block = &pb->second;
+							break;
+						}
+					}
+					if (block == nullptr)
+					{
+						output(text, frame._change_line);
+						continue;
+					}
 
-							// case 1 -> id -> case 0
-							p = get_identifier(line, pos + 1);
-							if (p.second == -1)
-								throw MiniC_Universal_Exception{
-								"Incorrect format in macro \"" + macro + "\"",
-								line_num, static_cast<std::size_t>(pos + 1) };
-							pos = p.second;
-							Macros::push_arg(macro, p.first, pos - p.first.size());
-							_case = 0;
+					if (block->_macro_type == macro_t::null)
+						throw MiniC_Universal_Exception(
+							"Expected something for macro \"" + block->_macro + "\"",
+							line_num, pos + block->_macro.size());
 
-						} // end while-loop for function macro
+					if (depth == max_depth)
+						throw MiniC_Universal_Exception(
+							"Macro \"" + block->_macro + "\" is nested deeper than "
+							+ std::to_string(max_depth) + " levels",
+							line_num, pos);
 
-					}
+					std::size_t end = pos + block->_macro.size();
+					_params.clear();
+					if (block->_macro_type == macro_t::function)
+						end = parse_params(text, end, *block, line_num, _params); // throw MiniC_Universal_Exception
 
-					// "#define xxx ..."
-					else
-					{
-						Macros::define_macro(macro, Macros::macro_t::object, line_num);
-					}
+					output(text.substr(0, pos), false);
+					if (depth == 0) trace.enter(block->_macro, text.data() - line.data() + pos, end - pos);
+					else trace.enter(block->_macro, 0, 0);
 
-					// push replace line for "macro_t::object" and "macro_t::function"
-					// `pos` denotes the start // `pos` <= `size`
-					bool next_line = false;
-					int _pos = pos;
-					while (pos < size && line[pos] != '\\') pos++;
-					if (pos != _pos)
-						Macros::push_replace(macro, std::string(line, _pos, pos - _pos));
-					if (pos != size) next_line = true;
-					it = lines.erase(it); // erase this line
-					while (next_line)
+					if (depth == 0 && block->_macro_type == macro_t::function)
 					{
-						next_line = false;
-						if (it == lines.end())
-							throw MiniC_Universal_Exception{
-							"Expected more lines after macro",
-							line_num, 0 };
-						line = std::get<0>(*it);
-						line_num = std::get<1>(*it);
-						size = line.size();
-						pos = 0;
-						while (pos < size && line[pos] != '\\') pos++;
-						Macros::push_replace(macro, std::string(line, 0, pos));
-						if (pos != size) next_line = true;
-						it = lines.erase(it); // erase this line
+						_cache_key.assign(block->_macro);
+						for (param_t param : _params)
+							_cache_key.append(1, '\0').append(param);
+						auto it = _cache.find(_cache_key);
+						if (it != _cache.end() && it->second._generation == _generation)
+						{
+							_cache_hits++;
+							it->second._replayed = true;
+							replay(it->second, line_num, emit, trace);
+							trace.leave();
+							stack.push_back(frame_t{ text.substr(end), frame._change_line, nullptr });
+							continue;
+						}
+						_cache_misses++;
+						recording = &record(it);
 					}
+					else if (recording)
+						recording->_ops.push_back(cached_t::op_t{ cached_t::op_kind::enter, &block->_macro, 0, 0, false });
+
+					// the rest of the text is scanned after the macro is unhidden
+					stack.push_back(frame_t{ text.substr(end), frame._change_line, nullptr });
+					stack.push_back(frame_t{ {}, false, block });
+					block->_hidden = true;
+					depth++;
+
+					_lines.clear();
+					block->expand(_params, _arena, _lines);
+					for (std::size_t i = _lines.size(); i-- > 0; )
+						stack.push_back(frame_t{ _lines[i], i + 1 != _lines.size(), nullptr });
 				}
-				catch (MiniC_Universal_Exception&) { throw; }
-			} // end "#define"
+			}
+			catch (MiniC_Universal_Exception&) {
+				for (frame_t const& frame : stack)
+					if (frame._unhide) frame._unhide->_hidden = false;
+				throw;
+			}
+		} // end function replace();
+
+		std::size_t max_depth = 256;
+		std::size_t _cache_hits = 0;
+		std::size_t _cache_misses = 0;
 
+		/*
+		 * snapshot: magic, the count of macros, and each `DefineBlock::save()`,
+		 * the macros are sorted by name, so the same table gives the same bytes.
+		 */
+		void save(std::ostream& out) const
+		{
+			std::vector<const DefineBlock*> blocks;
+			for (auto const&[s, b] : macros)
+				blocks.push_back(&b);
+			std::sort(blocks.begin(), blocks.end(),
+				[](const DefineBlock* a, const DefineBlock* b) { return a->_macro < b->_macro; });
+
+			std::string data{ snapshot_magic };
+			put_u32(data, static_cast<std::uint32_t>(blocks.size()));
+			for (const DefineBlock* block : blocks)
+				block->save(data);
+			out.write(data.data(), data.size());
+		}
 
-			// `#undef`
-			else if (line._Starts_with("#undef "))
+		// throw MiniC_Universal_Exception for a broken snapshot, or a macro defined already
+		void load(std::string_view data)
+		{
+			SnapshotReader in{ data };
+			if (in.bytes(snapshot_magic.size()) != snapshot_magic) in.broken();
+			const std::uint32_t count = in.u32();
+			macros.reserve(macros.size() + std::min<std::size_t>(count, data.size()));
+			for (std::uint32_t i = 0; i < count; i++)
 			{
-				std::pair<std::string, int> p;
-				p = get_identifier(line, 7);
-				int pos = p.second;
-				if (pos == -1)
-					throw MiniC_Universal_Exception{ "Expected identifier after \"#undef\"", line_num, 7 };
-				const std::string macro{ p.first };
-				Macros::undef_macro(macro, line_num, pos - macro.size()); // might throw `MiniC_Universal_Exception`
-				it = lines.erase(it); // erase this line
-			} // end "#undef"
+				DefineBlock block = DefineBlock::load(in);
+				if (macros.count(block._macro))
+					throw MiniC_Universal_Exception(
+						std::string("The macro \"") + block._macro + "\" has already been defined",
+						block._line_num, 0);
+				add_filter(block._macro);
+				_generation++;
+				std::string macro = block._macro;
+				macros.emplace(std::move(macro), std::move(block));
+			}
+			if (!in.done()) in.broken();
+		}
 
+		bool is_defined(std::string_view macro)
+		{
+			_key.assign(macro.data(), macro.size());
+			return macros.count(_key) != 0;
+		}
 
-			// may replace
-			else
+		/*
+		 * text of the condition in "#if", ready to be tokenized:
+		 *     "defined X" and "defined(X)" become "1" or "0" first,
+		 *     then the macros are replaced, the lines of a macro are joined by ' '.
+		 * throw MiniC_Universal_Exception
+		 */
+		std::string expand_condition(std::string_view line, std::size_t line_num)
+		{
+			std::string text;
+			const std::size_t size = line.size();
+			std::size_t pos = 0;
+			while (pos < size)
 			{
-				std::list<std::tuple<std::string, std::size_t, bool>> new_lines =
-					Macros::replace(line, std::get<1>(*it), std::get<2>(*it));
-				if (new_lines.size() == 1 && std::get<0>(new_lines.front()) == line)
+				if (util::char_is(line[pos], util::char_class::digit)) // "1e5" is not an identifier
+				{
+					const std::size_t start = pos;
+					while (pos < size && (util::char_is(line[pos], util::char_class::word) || line[pos] == '.')) pos++;
+					text.append(line.substr(start, pos - start));
+					continue;
+				}
+				const auto p = get_identifier(line, pos);
+				if (p.second == -1 || line[pos] == ' ')
+				{
+					text.push_back(line[pos++]);
+					continue;
+				}
+				pos = p.second;
+				if (p.first != "defined")
 				{
-					++it;
+					text.append(p.first);
 					continue;
 				}
-				it = lines.erase(it);
-				it = lines.insert(it, new_lines.begin(), new_lines.end());
-			} // end macro replace
 
-		} // end preprocess
+				// "defined X" or "defined(X)"
+				while (pos < size && line[pos] == ' ') pos++;
+				const bool parenthesis = pos < size && line[pos] == '(';
+				const auto id = get_identifier(line, pos + parenthesis);
+				if (id.second == -1)
+					throw MiniC_Universal_Exception{ "Expected identifier after \"defined\"", line_num, pos };
+				pos = id.second;
+				if (parenthesis)
+				{
+					while (pos < size && line[pos] == ' ') pos++;
+					if (pos == size || line[pos] != ')')
+						throw MiniC_Universal_Exception{ "Expected \")\" after \"defined\"", line_num, pos };
+					pos++;
+				}
+				text.push_back(is_defined(id.first) ? '1' : '0');
+			}
+
+			std::string expanded;
+			replace(text, line_num, false, [&expanded](std::string_view text, std::size_t, bool change_line) {
+				expanded.append(text);
+				if (change_line) expanded.push_back(' ');
+			}, no_trace{});
+			return expanded;
+		}
+
+		// for debug
+		void print(std::ostream& out) const
+		{
+			for (auto const&[s, b] : macros)
+				b.print(out);
+		}
+
+	}; // end class Macros;
+
+
+	namespace
+	{
+
+		/*
+		 * value of the condition in "#if", with the precedence of `constant_expression`:
+		 *     conditional, "||", "&&", "|", "^", "&", relational, shift,
+		 *     additive, multiplicative, unary ("!" "-"), "(" ")" and constants.
+		 * integers are computed in `long long` (wrapping on overflow), a float literal makes its operation double,
+		 * "|" "^" "&" "%" and the shifts take integers, a float operand is truncated.
+		 * identifiers which are not macros are 0, "true" and "false" are 1 and 0.
+		 * throw MiniC_Universal_Exception for ill-formed conditions, and for a division by zero,
+		 * a shift out of [0, 64) or a float out of the range of `long long`.
+		 */
+		class Condition
+		{
+		public:
+			Condition(const std::vector<lexer::token_info>& tokens, std::size_t line_num, std::size_t pos)
+				:_tokens(tokens), _line_num(line_num), _pos(pos) {}
+
+			bool eval()
+			{
+				if (_tokens.empty()) error("Expected condition after \"#if\"");
+				const value_t value = conditional();
+				if (_index != _tokens.size()) error("Unexpected token in the condition");
+				return value.truth();
+			}
+
+		private:
+			using type = lexer::type;
+
+			struct value_t
+			{
+				bool _real;
+				long long _int;
+				double _double;
+
+				static value_t of(long long value) { return value_t{ false, value, 0 }; }
+				static value_t of(double value) { return value_t{ true, 0, value }; }
+				static value_t of(bool value) { return of(static_cast<long long>(value)); }
+				double real() const { return _real ? _double : static_cast<double>(_int); }
+				bool truth() const { return _real ? _double != 0 : _int != 0; }
+			};
+
+			// the arithmetic of `long long` wraps as the unsigned one does, instead of overflowing
+			static long long wrap(unsigned long long value) { return static_cast<long long>(value); }
+
+			const std::vector<lexer::token_info>& _tokens;
+			const std::size_t _line_num, _pos;
+			std::size_t _index = 0;
+
+			[[noreturn]] void error(const std::string& msg) const
+			{
+				const std::size_t pos = _index < _tokens.size() ? std::get<lexer::pos_t>(_tokens[_index]) : 0;
+				throw MiniC_Universal_Exception{ msg, _line_num, _pos + pos };
+			}
+
+			bool accept(type t)
+			{
+				if (_index == _tokens.size()) return false;
+				const auto* token = std::get_if<type>(&std::get<lexer::token_t>(_tokens[_index]));
+				if (token == nullptr || *token != t) return false;
+				_index++;
+				return true;
+			}
+
+			void expect(type t)
+			{
+				if (!accept(t)) error("Expected \"" + lexer::type2str(t) + "\" in the condition");
+			}
+
+			long long integer(const value_t& value) const
+			{
+				if (!value._real) return value._int;
+				// [-2^63, 2^63), NaN is out too
+				if (!(value._double >= -9223372036854775808.0 && value._double < 9223372036854775808.0))
+					error("The value is out of the range of integers in the condition");
+				return static_cast<long long>(value._double);
+			}
+
+			value_t conditional()
+			{
+				const value_t value = logical_or();
+				if (!accept(type::QUESTION)) return value;
+				const value_t a = conditional();
+				expect(type::COLON);
+				const value_t b = logical_or();
+				return value.truth() ? a : b;
+			}
+
+			value_t logical_or()
+			{
+				value_t value = logical_and();
+				while (accept(type::LOGIC_OR))
+				{
+					const value_t rhs = logical_and();
+					value = value_t::of(value.truth() || rhs.truth());
+				}
+				return value;
+			}
+
+			value_t logical_and()
+			{
+				value_t value = bit_or();
+				while (accept(type::LOGIC_AND))
+				{
+					const value_t rhs = bit_or();
+					value = value_t::of(value.truth() && rhs.truth());
+				}
+				return value;
+			}
+
+			value_t bit_or()
+			{
+				value_t value = bit_xor();
+				while (accept(type::OR))
+				{
+					const value_t rhs = bit_xor();
+					value = value_t::of(integer(value) | integer(rhs));
+				}
+				return value;
+			}
+
+			value_t bit_xor()
+			{
+				value_t value = bit_and();
+				while (accept(type::XOR))
+				{
+					const value_t rhs = bit_and();
+					value = value_t::of(integer(value) ^ integer(rhs));
+				}
+				return value;
+			}
+
+			value_t bit_and()
+			{
+				value_t value = relational();
+				while (accept(type::AND))
+				{
+					const value_t rhs = relational();
+					value = value_t::of(integer(value) & integer(rhs));
+				}
+				return value;
+			}
+
+			// not associative: "a < b < c" is an error
+			value_t relational()
+			{
+				const value_t value = shift();
+				type op;
+				if (accept(type::LESS)) op = type::LESS;
+				else if (accept(type::GREATER)) op = type::GREATER;
+				else if (accept(type::LEQ)) op = type::LEQ;
+				else if (accept(type::GEQ)) op = type::GEQ;
+				else if (accept(type::EQ)) op = type::EQ;
+				else if (accept(type::NEQ)) op = type::NEQ;
+				else return value;
+				const value_t rhs = shift();
+				if (value._real || rhs._real) return value_t::of(compare(op, value.real(), rhs.real()));
+				return value_t::of(compare(op, value._int, rhs._int));
+			}
+
+			template<typename T>
+			static bool compare(type op, T a, T b)
+			{
+				switch (op)
+				{
+				case type::LESS: return a < b;
+				case type::GREATER: return a > b;
+				case type::LEQ: return a <= b;
+				case type::GEQ: return a >= b;
+				case type::EQ: return a == b;
+				default: return a != b;
+				}
+			}
+
+			value_t shift()
+			{
+				value_t value = additive();
+				for (;;)
+				{
+					const bool left = accept(type::LEFT_SHIFT);
+					if (!left && !accept(type::RIGHT_SHIFT)) return value;
+					const value_t rhs = additive();
+					const long long a = integer(value), b = integer(rhs);
+					if (b < 0 || b >= 64) error("The shift is out of [0, 64) in the condition");
+					value = value_t::of(left ? wrap(static_cast<unsigned long long>(a) << b) : a >> b);
+				}
+			}
+
+			value_t additive()
+			{
+				value_t value = multiplicative();
+				for (;;)
+				{
+					const bool add = accept(type::ADD);
+					if (!add && !accept(type::SUB)) return value;
+					const value_t rhs = multiplicative();
+					if (value._real || rhs._real) value = value_t::of(add ? value.real() + rhs.real() : value.real() - rhs.real());
+					else value = value_t::of(add ? wrap(static_cast<unsigned long long>(value._int) + static_cast<unsigned long long>(rhs._int))
+						: wrap(static_cast<unsigned long long>(value._int) - static_cast<unsigned long long>(rhs._int)));
+				}
+			}
+
+			value_t multiplicative()
+			{
+				value_t value = unary();
+				for (;;)
+				{
+					if (accept(type::MUL))
+					{
+						const value_t rhs = unary();
+						if (value._real || rhs._real) value = value_t::of(value.real() * rhs.real());
+						else value = value_t::of(wrap(static_cast<unsigned long long>(value._int) * static_cast<unsigned long long>(rhs._int)));
+					}
+					else if (accept(type::DIV) || accept(type::MOD))
+					{
+						const bool mod = std::get<type>(std::get<lexer::token_t>(_tokens[_index - 1])) == type::MOD;
+						const value_t rhs = unary();
+						if (!mod && (value._real || rhs._real))
+						{
+							if (rhs.real() == 0) error("Division by zero in the condition");
+							value = value_t::of(value.real() / rhs.real());
+							continue;
+						}
+						const long long a = integer(value), b = integer(rhs);
+						if (b == 0) error("Division by zero in the condition");
+						// LLONG_MIN / -1 overflows, the result wraps to LLONG_MIN and the remainder is 0
+						if (b == -1) value = value_t::of(mod ? 0LL : wrap(0ULL - static_cast<unsigned long long>(a)));
+						else value = value_t::of(mod ? a % b : a / b);
+					}
+					else return value;
+				}
+			}
+
+			value_t unary()
+			{
+				if (accept(type::LOGIC_NOT)) return value_t::of(!unary().truth());
+				if (accept(type::SUB))
+				{
+					const value_t value = unary();
+					return value._real ? value_t::of(-value._double) : value_t::of(wrap(0ULL - static_cast<unsigned long long>(value._int)));
+				}
+				return primary();
+			}
+
+			value_t primary()
+			{
+				if (accept(type::LEFT_PARENTHESIS))
+				{
+					const value_t value = conditional();
+					expect(type::RIGHT_PARENTHESIS);
+					return value;
+				}
+				if (accept(type::TRUE)) return value_t::of(1LL);
+				if (accept(type::FALSE)) return value_t::of(0LL);
+				if (_index == _tokens.size()) error("Unexpected end of the condition");
+				const lexer::token_t& token = std::get<lexer::token_t>(_tokens[_index]);
+				if (const auto* number = std::get_if<lexer::numeric_t>(&token))
+				{
+					_index++;
+					const lexer::numeric_type kind = std::get<1>(*number);
+					if (kind == lexer::numeric_type::F32 || kind == lexer::numeric_type::F64)
+						return value_t::of(lexer::numeric_cast<double>(*number));
+					return value_t::of(lexer::numeric_cast<long long>(*number));
+				}
+				if (std::holds_alternative<lexer::identifier>(token))
+				{
+					_index++;
+					return value_t::of(0LL);
+				}
+				error("Unexpected token in the condition");
+			}
+		}; // end class Condition;
+
+
+		/*
+		 * one "#if" ... "#endif" group
+		 *     _active : the lines of the current branch are kept
+		 *     _taken  : some branch is kept (or the whole group is in a skipped region),
+		 *               so the following branches are skipped
+		 */
+		struct cond_t
+		{
+			bool _active;
+			bool _taken;
+			bool _else;
+			std::size_t _line;
+		};
+
+	} // end anonymous namespace
+
+
+	namespace
+	{
+
+		void put_varint(std::string& out, std::size_t value)
+		{
+			for (; value >= 0x80; value >>= 7)
+				out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+			out.push_back(static_cast<char>(value));
+		}
+
+		std::size_t get_varint(const std::string& in, std::size_t& pos)
+		{
+			std::size_t value = 0;
+			for (int shift = 0; ; shift += 7)
+			{
+				const unsigned char byte = static_cast<unsigned char>(in[pos++]);
+				value |= static_cast<std::size_t>(byte & 0x7F) << shift;
+				if (byte < 0x80) return value;
+			}
+		}
+
+	} // end anonymous namespace
+
+
+	void ExpansionMap::enter(std::string_view macro, std::size_t begin, std::size_t call_column, std::size_t call_size)
+	{
+		auto it = _macro_indices.try_emplace(std::string(macro), static_cast<std::uint32_t>(_macros.size())).first;
+		if (it->second == _macros.size()) _macros.push_back(it->first);
+		_open.push_back(_pending.size());
+		_pending.push_back(pending_t{ begin, begin, it->second, call_column, call_size });
+	}
+
+	void ExpansionMap::leave(std::size_t end)
+	{
+		_pending[_open.back()]._end = end;
+		_open.pop_back();
+	}
+
+	void ExpansionMap::finish()
+	{
+		std::size_t last = 0;
+		std::vector<std::size_t> open; // in `_pending`, as `stack_at()` keeps them
+		std::size_t settled = SIZE_MAX;
+		for (std::size_t i = 0; i < _pending.size(); i++)
+		{
+			const pending_t& entry = _pending[i];
+			for (; !open.empty() && _pending[open.back()]._end <= entry._begin; open.pop_back())
+				if (_pending[open.back()]._call_size != 0 && (settled == SIZE_MAX || open.back() > settled)) settled = open.back();
+			if (i % checkpoint_step == 0)
+			{
+				checkpoint_t checkpoint{ entry._begin, _bytes.size(), last, _open_stacks.size(), 0, settled != SIZE_MAX, {} };
+				for (std::size_t index : open) _open_stacks.push_back(indexed_t{ index, _pending[index] });
+				checkpoint._open_end = _open_stacks.size();
+				if (checkpoint._has_settled) checkpoint._settled = indexed_t{ settled, _pending[settled] };
+				_checkpoints.push_back(checkpoint);
+			}
+			open.push_back(i);
+
+			put_varint(_bytes, entry._begin - last);
+			put_varint(_bytes, entry._end - entry._begin);
+			put_varint(_bytes, entry._macro);
+			put_varint(_bytes, entry._call_column);
+			put_varint(_bytes, entry._call_size);
+			last = entry._begin;
+		}
+		_count += _pending.size();
+		_pending = {};
+		_open = {};
+		_macro_indices = {};
+	}
+
+	void ExpansionMap::clear()
+	{
+		_macros.clear();
+		_bytes.clear();
+		_count = 0;
+		_checkpoints.clear();
+		_open_stacks.clear();
+		_macro_indices.clear();
+		_pending.clear();
+		_open.clear();
+	}
+
+	const ExpansionMap::checkpoint_t* ExpansionMap::checkpoint_for(std::size_t offset) const
+	{
+		auto it = std::upper_bound(_checkpoints.begin(), _checkpoints.end(), offset,
+			[](std::size_t offset, const checkpoint_t& checkpoint) { return offset < checkpoint._entry_begin; });
+		return it == _checkpoints.begin() ? nullptr : &*(it - 1);
+	}
+
+	ExpansionMap::expansion_t ExpansionMap::entry_of(const pending_t& entry) const
+	{
+		return expansion_t{ entry._begin, entry._end, _macros[entry._macro], entry._call_column, entry._call_size };
+	}
+
+	/*
+	 * decode from the checkpoint, the open expansions are kept in a stack:
+	 * an entry beginning at or after the end of the top one is not nested in it.
+	 */
+	std::vector<ExpansionMap::expansion_t> ExpansionMap::stack_at(std::size_t offset) const
+	{
+		std::vector<expansion_t> stack;
+		std::size_t pos = 0, begin = 0;
+		if (const checkpoint_t* checkpoint = checkpoint_for(offset))
+		{
+			for (std::size_t i = checkpoint->_open; i < checkpoint->_open_end; i++)
+				stack.push_back(entry_of(_open_stacks[i]._entry));
+			pos = checkpoint->_pos;
+			begin = checkpoint->_base;
+		}
+		while (pos < _bytes.size())
+		{
+			begin += get_varint(_bytes, pos);
+			if (begin > offset) break;
+			expansion_t entry{ begin, begin + get_varint(_bytes, pos), {}, 0, 0 };
+			entry._macro = _macros[get_varint(_bytes, pos)];
+			entry._call_column = get_varint(_bytes, pos);
+			entry._call_size = get_varint(_bytes, pos);
+			while (!stack.empty() && stack.back()._end <= entry._begin) stack.pop_back();
+			stack.push_back(entry);
+		}
+		while (!stack.empty() && stack.back()._end <= offset) stack.pop_back();
+		return stack;
+	}
+
+	/*
+	 * an entry before the checkpoint which does not contain the checkpoint's begin ends before `offset`,
+	 * the last of them is `_settled`, the ones which contain it are `_open`.
+	 */
+	bool ExpansionMap::last_before(std::size_t offset, expansion_t& result) const
+	{
+		bool found = false;
+		std::size_t pos = 0, begin = 0;
+		if (const checkpoint_t* checkpoint = checkpoint_for(offset))
+		{
+			const indexed_t* last = checkpoint->_has_settled ? &checkpoint->_settled : nullptr;
+			for (std::size_t i = checkpoint->_open; i < checkpoint->_open_end; i++)
+			{
+				const indexed_t& open = _open_stacks[i];
+				if (open._entry._call_size != 0 && open._entry._end <= offset && (last == nullptr || open._index > last->_index)) last = &open;
+			}
+			if (last)
+			{
+				result = entry_of(last->_entry);
+				found = true;
+			}
+			pos = checkpoint->_pos;
+			begin = checkpoint->_base;
+		}
+		while (pos < _bytes.size())
+		{
+			begin += get_varint(_bytes, pos);
+			const std::size_t end = begin + get_varint(_bytes, pos);
+			const std::size_t macro = get_varint(_bytes, pos);
+			const std::size_t call_column = get_varint(_bytes, pos);
+			const std::size_t call_size = get_varint(_bytes, pos);
+			if (begin > offset) break;
+			if (call_size == 0 || end > offset) continue; // nested, or containing `offset`
+			result = expansion_t{ begin, end, _macros[macro], call_column, call_size };
+			found = true;
+		}
+		return found;
+	}
+
+
+	PreprocessContext::PreprocessContext() :_macros(std::make_unique<Macros>()) {}
+	PreprocessContext::~PreprocessContext() = default;
+
+	void PreprocessContext::set_max_expansion_depth(std::size_t depth) { _macros->max_depth = depth; }
+
+	void PreprocessContext::print(std::ostream& out) const { _macros->print(out); }
+
+	PreprocessContext::cache_stats_t PreprocessContext::expansion_cache_stats() const
+	{
+		return cache_stats_t{ _macros->_cache_hits, _macros->_cache_misses };
+	}
+
+	void PreprocessContext::collect_stats(bool enable)
+	{
+		_collect_stats = enable;
+		_stats = PreprocessStats{};
+	}
 
-		Macros::print(out);
+
+	/*
+	 * one object, the expansions are ordered by count, the most used first:
+	 *     { "files": 1, ..., "expansions": { "MAX": 12, ... }, "time_ms": { "read": 0.1, ... } }
+	 */
+	void PreprocessStats::write_json(std::ostream& out) const
+	{
+		auto quoted = [&out](std::string_view s)
+		{
+			out << '"';
+			for (const char c : s)
+			{
+				if (c == '"' || c == '\\') out << '\\' << c;
+				else if (static_cast<unsigned char>(c) < 0x20)
+					out << "\\u00" << "0123456789abcdef"[(c >> 4) & 0xf] << "0123456789abcdef"[c & 0xf];
+				else out << c;
+			}
+			out << '"';
+		};
+
+		std::vector<std::pair<std::string_view, std::size_t>> expansions(_expansions.begin(), _expansions.end());
+		std::sort(expansions.begin(), expansions.end(), [](const auto& a, const auto& b)
+			{ return a.second != b.second ? a.second > b.second : a.first < b.first; });
+
+		out << "{\n"
+			<< "  \"files\": " << _files << ",\n"
+			<< "  \"lines\": " << _lines << ",\n"
+			<< "  \"directives\": " << _directives << ",\n"
+			<< "  \"skipped_lines\": " << _skipped_lines << ",\n"
+			<< "  \"bytes_in\": " << _bytes_in << ",\n"
+			<< "  \"bytes_out\": " << _bytes_out << ",\n"
+			<< "  \"max_expansion_depth\": " << _max_depth << ",\n"
+			<< "  \"cache_hits\": " << _cache_hits << ",\n"
+			<< "  \"cache_misses\": " << _cache_misses << ",\n"
+			<< "  \"expansions\": {";
+		for (std::size_t i = 0; i < expansions.size(); i++)
+		{
+			out << (i ? ",\n    " : "\n    ");
+			quoted(expansions[i].first);
+			out << ": " << expansions[i].second;
+		}
+		out << (expansions.empty() ? "},\n" : "\n  },\n")
+			<< "  \"time_ms\": { \"read\": " << _read_ms << ", \"directive\": " << _directive_ms
+			<< ", \"expand\": " << _expand_ms << ", \"total\": " << _total_ms << " }\n"
+			<< "}\n";
+	}
+
+
+	/*
+	 * expand the macros, and keep the result in memory
+	 * the error is also kept in `_diagnostics`
+	 */
+	void PreprocessContext::preprocess(const std::string& file_name, ExpandedSource& result)
+	{
+		try { preprocess_file(file_name, result); }
+		catch (const MiniC_Universal_Exception& e) {
+			std::ostringstream os;
+			os << file_name << ": " << e;
+			_diagnostics.push_back(os.str());
+			throw;
+		}
+	}
+
+	namespace
+	{
+
+		// add the time of its scope to `*ms`, nothing if `ms` is null
+		class phase_timer
+		{
+		public:
+			explicit phase_timer(double* ms) :_ms(ms)
+			{
+				if (_ms) _start = std::chrono::steady_clock::now();
+			}
+			phase_timer(const phase_timer&) = delete;
+			phase_timer& operator=(const phase_timer&) = delete;
+			~phase_timer()
+			{
+				if (_ms) *_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+			}
+		private:
+			double* _ms;
+			std::chrono::steady_clock::time_point _start;
+		};
+
+		/*
+		 * the line and the column of the first byte of `source` which is no valid UTF-8, line 0 if it is all valid.
+		 */
+		std::pair<std::size_t, std::size_t> find_invalid_utf8(const util::SourceBuffer& source)
+		{
+			const char* text = source.data();
+			const std::size_t bad = util::simd::find_invalid_utf8(text, source.size());
+			if (bad == source.size()) return { 0, 0 };
+			const std::size_t line = std::count(text, text + bad, '\n') + 1;
+			const char* line_start = text + bad;
+			while (line_start != text && line_start[-1] != '\n') line_start--;
+			return { line, static_cast<std::size_t>(text + bad - line_start) };
+		}
+
+		/*
+		 * the comments are cut out of the lines before anything else, as in C, so nothing in them is expanded:
+		 *     a comment at the end of a line is cut off the view, nothing is copied,
+		 *     a comment followed by code on its line becomes spaces, so the code keeps its columns,
+		 *     the lines in a block comment become empty, so the lines keep their numbers.
+		 * "//" in a string or char literal is no comment, the lines changed are kept in `storage`.
+		 * the line and the column of a block comment which is not closed are returned, line 0 if there is none.
+		 */
+		std::pair<std::size_t, std::size_t> strip_comments(std::vector<std::string_view>& lines, std::deque<std::string>& storage)
+		{
+			std::pair<std::size_t, std::size_t> open{ 0, 0 };
+			std::vector<std::pair<std::size_t, std::size_t>> comments;      // `[begin, end)` on the line
+			bool in_comment = false;
+			for (std::size_t index = 0; index < lines.size(); index++)
+			{
+				const std::string_view line = lines[index];
+				const std::size_t size = line.size();
+				if (!in_comment && std::memchr(line.data(), '/', size) == nullptr) continue; // most lines
+
+				comments.clear();
+				std::size_t pos = 0;
+				if (in_comment)
+				{
+					const std::size_t end = util::simd::find_comment_end(line.data(), 0, size);
+					in_comment = end == size;
+					pos = in_comment ? size : end + 2;
+					comments.emplace_back(0, pos);
+				}
+				while (pos < size)
+				{
+					pos = line.find_first_of("/\"'", pos);
+					if (pos == std::string_view::npos) break;
+					if (line[pos] != '/')
+					{
+						const char quote = line[pos];
+						for (pos++; pos < size && line[pos] != quote; pos++)
+							if (line[pos] == '\\') pos++;
+						pos++;
+					}
+					else if (pos + 1 < size && line[pos + 1] == '/')
+					{
+						comments.emplace_back(pos, size);
+						break;
+					}
+					else if (pos + 1 < size && line[pos + 1] == '*')
+					{
+						const std::size_t end = util::simd::find_comment_end(line.data(), pos + 2, size);
+						in_comment = end == size;
+						if (in_comment) open = { index + 1, pos };
+						comments.emplace_back(pos, in_comment ? size : end + 2);
+						pos = comments.back().second;
+					}
+					else pos++;
+				}
+				if (comments.empty()) continue;
+
+				// a comment with only blanks after it ends the line, then the blanks before it are cut too
+				std::size_t cut = size;
+				if (line.find_first_not_of(" \t", comments.back().second) == std::string_view::npos)
+				{
+					cut = comments.back().first;
+					comments.pop_back();
+				}
+				const std::size_t code_begin = comments.empty() ? 0 : comments.back().second;
+				while (cut > code_begin && (line[cut - 1] == ' ' || line[cut - 1] == '\t')) cut--;
+				if (comments.empty())
+				{
+					lines[index] = line.substr(0, cut);
+					continue;
+				}
+				std::string& stripped = storage.emplace_back();
+				stripped.reserve(cut);
+				std::size_t code = 0;
+				for (auto [begin, end] : comments)
+				{
+					stripped.append(line.substr(code, begin - code)).append(end - begin, ' ');
+					code = end;
+				}
+				stripped.append(line.substr(code, cut - code));
+				lines[index] = stripped;
+			}
+			return in_comment ? open : std::pair<std::size_t, std::size_t>{ 0, 0 };
+		}
+
+
+		/*
+		 * content of a file read by "#include", shared by all the contexts.
+		 *     _once  : the file has "#pragma once"
+		 *     _guard : macro of the include guard, the whole file is in
+		 *              "#ifndef X" "#define X" ... "#endif", or empty
+		 *     _lines : without the comments, `_stripped` keeps the lines which are not views of `_source`
+		 *     _open_comment, _invalid_utf8 : where the file is wrong, line 0 if it is not, thrown where it is included
+		 */
+		struct CachedFile
+		{
+			util::SourceBuffer _source;
+			std::vector<std::string_view> _lines;
+			std::deque<std::string> _stripped;
+			std::pair<std::size_t, std::size_t> _open_comment{ 0, 0 };
+			std::pair<std::size_t, std::size_t> _invalid_utf8{ 0, 0 };
+			bool _once = false;
+			std::string _guard;
+		};
+
+		/*
+		 * files are read and scanned for "#pragma once" and the include guard only once in the process,
+		 * the cache lives until `clear_file_cache()`.
+		 */
+		class FileCache
+		{
+		public:
+			static FileCache& instance()
+			{
+				static FileCache cache;
+				return cache;
+			}
+
+			// nullptr if the file cannot be opened
+			std::shared_ptr<const CachedFile> get(const std::string& path)
+			{
+				{
+					std::shared_lock<std::shared_mutex> lock{ _mutex };
+					auto it = _files.find(path);
+					if (it != _files.end()) return it->second;
+				}
+
+				// read outside the lock, the first one inserted wins
+				auto file = std::make_shared<CachedFile>();
+				if (!file->_source.open(path)) return nullptr;
+				file->_invalid_utf8 = find_invalid_utf8(file->_source);
+				for (std::string_view line : file->_source.lines())
+					file->_lines.push_back(line);
+				// the '\n' at the end of file is not an empty line of the including file
+				if (file->_lines.size() > 1 && file->_lines.back().empty()) file->_lines.pop_back();
+				file->_open_comment = strip_comments(file->_lines, file->_stripped);
+				detect_once(*file);
+
+				std::unique_lock<std::shared_mutex> lock{ _mutex };
+				return _files.try_emplace(path, std::move(file)).first->second;
+			}
+
+			void clear()
+			{
+				std::unique_lock<std::shared_mutex> lock{ _mutex };
+				_files.clear();
+			}
+
+		private:
+			static void detect_once(CachedFile& file)
+			{
+				std::string_view guard;
+				bool valid = true, closed = false;
+				std::size_t depth = 0, directives = 0;
+				for (std::string_view line : file._lines)
+				{
+					const std::size_t first = line.find_first_not_of(" \t");
+					if (first == std::string_view::npos) continue;
+					if (line[first] != '#')
+					{
+						if (depth == 0) valid = false;
+						continue;
+					}
+					const auto p = get_identifier(line, static_cast<int>(first) + 1);
+					const std::string_view directive = p.first;
+					const std::string_view name = p.second == -1 ? std::string_view{} : get_identifier(line, p.second).first;
+					if (directive == "pragma")
+					{
+						if (name == "once") file._once = true;
+						continue;
+					}
+
+					// "#ifndef X" and "#define X" open the file, the "#endif" closes it
+					directives++;
+					if (closed) valid = false;
+					if (directives == 1)
+					{
+						if (directive == "ifndef") guard = name;
+						else valid = false;
+					}
+					else if (directives == 2 && (directive != "define" || name != guard))
+						valid = false;
+
+					if (directive == "if" || directive == "ifdef" || directive == "ifndef") depth++;
+					else if ((directive == "else" || directive == "elif") && depth == 1) valid = false;
+					else if (directive == "endif" && depth > 0 && --depth == 0) closed = true;
+				}
+				if (valid && closed && !guard.empty()) file._guard = guard;
+			}
+
+			std::shared_mutex _mutex;
+			std::unordered_map<std::string, std::shared_ptr<const CachedFile>> _files;
+		};
+
+
+		/*
+		 * expand the lines of one file into `_result`,
+		 * the included files are scanned recursively, a "#if" group may not cross files.
+		 */
+		class Scanner
+		{
+		public:
+			// `stats` is null if they are not collected
+			Scanner(Macros& macros, ExpandedSource& result, PreprocessStats* stats = nullptr)
+				:_macros(macros), _result(result), _stats(stats), _trace{ result, stats } {}
+
+			void scan(const std::vector<std::string_view>& lines, const std::string& file_name, bool top_level)
+			{
+				Macros& macros = _macros;
+				const std::size_t count = lines.size();
+				const std::uint32_t file = file_index(file_name);
+				if (_stats)
+				{
+					_stats->_files++;
+					_stats->_lines += count;
+				}
+
+				// every new line in `result._text` records its original line number
+				auto emit = [this, file](std::string_view text, std::size_t line_num, bool change_line)
+				{
+					start_line(line_num, file);
+					_result._text.append(text);
+					if (change_line)
+					{
+						_result._text.push_back('\n');
+						_at_line_start = true;
+					}
+				};
+
+				// value of "#if ...", "#ifdef X" and "#ifndef X", `line` is the text after the directive
+				auto condition = [&macros = _macros](std::string_view directive, std::string_view line, std::size_t line_num, std::size_t pos)
+				{
+					if (directive != "if")
+					{
+						const auto p = get_identifier(line, 0);
+						if (p.second == -1)
+							throw MiniC_Universal_Exception{ "Expected identifier after \"#" + std::string(directive) + "\"", line_num, pos };
+						return macros.is_defined(p.first) == (directive == "ifdef");
+					}
+					const std::string text = macros.expand_condition(line, line_num);
+					const auto tokens = lexer::tokenize(text.c_str(), text.size());
+					if (const auto* ex = std::get_if<lexer::analyzers::Token_Ex>(&tokens))
+						throw MiniC_Universal_Exception{ ex->_msg, line_num, pos + ex->_position };
+					return Condition{ std::get<std::vector<lexer::token_info>>(tokens), line_num, pos }.eval();
+				};
+				std::vector<cond_t> conds;
+
+				for (std::size_t index = 0; index < count; )
+				{
+					std::string_view line = lines[index];
+					std::size_t line_num = index + 1;
+					std::size_t size = line.size();
+
+					// conditional directives are looked at in the skipped regions too
+					if (size != 0 && line[0] == '#')
+					{
+						const auto p = get_identifier(line, 1);
+						const std::string_view directive = p.first;
+						if (directive == "if" || directive == "ifdef" || directive == "ifndef")
+						{
+							const phase_timer timer = directive_phase();
+							const bool skipped = !conds.empty() && !conds.back()._active;
+							const bool active = !skipped && condition(directive, line.substr(p.second), line_num, p.second);
+							conds.push_back(cond_t{ active, skipped || active, false, line_num });
+							index++; // erase this line
+							continue;
+						}
+						if (directive == "elif" || directive == "else")
+						{
+							const phase_timer timer = directive_phase();
+							if (conds.empty() || conds.back()._else)
+								throw MiniC_Universal_Exception{ "Unexpected \"#" + std::string(directive) + "\"", line_num, 0 };
+							cond_t& cond = conds.back();
+							cond._else = directive == "else";
+							cond._active = !cond._taken
+								&& (cond._else || condition("if", line.substr(p.second), line_num, p.second));
+							cond._taken = cond._taken || cond._active;
+							index++; // erase this line
+							continue;
+						}
+						if (directive == "endif")
+						{
+							const phase_timer timer = directive_phase();
+							if (conds.empty())
+								throw MiniC_Universal_Exception{ "Unexpected \"#endif\"", line_num, 0 };
+							conds.pop_back();
+							index++; // erase this line
+							continue;
+						}
+					}
+
+					// skipped region: the lines are neither tokenized nor expanded, only the first char is looked at
+					if (!conds.empty() && !conds.back()._active)
+					{
+						// a skipped "#define" may go on in the following lines
+						if (size != 0 && line[0] == '#')
+							while (index + 1 < count && !lines[index].empty() && lines[index].back() == '\\') index++;
+						index++;
+						while (index < count && (lines[index].empty() || lines[index][0] != '#')) index++;
+						if (_stats) _stats->_skipped_lines += index - (line_num - 1);
+						continue;
+					}
+
+					// `#define` must be at the start of one line
+					if (line._Starts_with("#define "))
+					{
+						const phase_timer timer = directive_phase();
+						std::pair<std::string_view, int> p;
+						p = get_identifier(line, 8);
+						int pos = p.second;
+						if (pos == -1)
+							throw MiniC_Universal_Exception{ "Expected identifier after \"#define\"", line_num, 8 };
+						const std::string macro{ p.first };
+
+						while (pos < size && line[pos] == ' ') pos++;
+
+						try {
+
+							// "#define xxx"
+							if (pos == size)
+							{
+								macros.define_macro(macro, Macros::macro_t::null, line_num);
+								index++; // erase this line
+								continue;
+							}
+
+							// "#define foo(...)"
+							if (line[pos] == '(')
+							{
+								macros.define_macro(macro, Macros::macro_t::function, line_num);
+
+								pos++;
+								// detect "foo()"
+								if (pos == size)
+									throw MiniC_Universal_Exception{
+									"Expected something for macro \"" + macro + "\"",
+									line_num, static_cast<std::size_t>(pos) };
+
+								int _case = 0;
+								if (line[pos] == ')')
+								{
+									_case = 2;
+									pos++;
+								}
+								if (_case == 0)
+								{
+									p = get_identifier(line, pos);
+									if (p.second == -1)
+										throw MiniC_Universal_Exception{
+										"Incorrect format in macro \"" + macro + "\"",
+										line_num, static_cast<std::size_t>(pos) };
+									pos = p.second;
+									macros.push_arg(macro, std::string(p.first), pos - p.first.size());
+								}
+								// case   -> (  -> case 0
+								// detect: *(, id) ")"
+								// case 0 -> ,  -> case 1
+								// case 1 -> id -> case 0
+								// case 0 -> )  -> case 2 -> ok
+								//          ,  id   )
+								// case0:   1, -1,  2 
+								// case1:  -1,  0, -1
+								while (_case != 2)
+								{
+									while (pos < size && line[pos] == ' ') pos++;
+									if (pos == size)
+										throw MiniC_Universal_Exception{
+										"Incorrect format in macro \"" + macro + "\"",
+										line_num, static_cast<std::size_t>(pos) };
+
+									if (_case == 0)
+									{
+										// case 0 -> )  -> case 2 -> ok
+										if (line[pos] == ')' && _case == 0)
+										{
+											pos++;
+											break;
+										}
+
+										// case 0 -> ,  -> case 1
+										if (line[pos] == ',' && _case == 0)
+										{
+											_case = 1;
+											continue;
+										}
+
+										throw MiniC_Universal_Exception{
+											"Incorrect format in macro \"" + macro + "\"",
+											line_num, static_cast<std::size_t>(pos) };
+									}
+
+									// case 1 -> id -> case 0
+									p = get_identifier(line, pos + 1);
+									if (p.second == -1)
+										throw MiniC_Universal_Exception{
+										"Incorrect format in macro \"" + macro + "\"",
+										line_num, static_cast<std::size_t>(pos + 1) };
+									pos = p.second;
+									macros.push_arg(macro, std::string(p.first), pos - p.first.size());
+									_case = 0;
+
+								} // end while-loop for function macro
+
+							}
+
+							// "#define xxx ..."
+							else
+							{
+								macros.define_macro(macro, Macros::macro_t::object, line_num);
+							}
+
+							// push replace line for "macro_t::object" and "macro_t::function"
+							// `pos` denotes the start // `pos` <= `size`
+							bool next_line = false;
+							int _pos = pos;
+							while (pos < size && line[pos] != '\\') pos++;
+							if (pos != _pos)
+								macros.push_replace(macro, line.substr(_pos, pos - _pos));
+							if (pos != size) next_line = true;
+							index++; // erase this line
+							while (next_line)
+							{
+								next_line = false;
+								if (index == count)
+									throw MiniC_Universal_Exception{
+									"Expected more lines after macro",
+									line_num, 0 };
+								line = lines[index];
+								line_num = index + 1;
+								size = line.size();
+								pos = 0;
+								while (pos < size && line[pos] != '\\') pos++;
+								macros.push_replace(macro, line.substr(0, pos));
+								if (pos != size) next_line = true;
+								index++; // erase this line
+							}
+						}
+						catch (MiniC_Universal_Exception&) { throw; }
+					} // end "#define"
+
+
+					// `#undef`
+					else if (line._Starts_with("#undef "))
+					{
+						const phase_timer timer = directive_phase();
+						std::pair<std::string_view, int> p;
+						p = get_identifier(line, 7);
+						int pos = p.second;
+						if (pos == -1)
+							throw MiniC_Universal_Exception{ "Expected identifier after \"#undef\"", line_num, 7 };
+						const std::string macro{ p.first };
+						macros.undef_macro(macro, line_num, pos - macro.size()); // might throw `MiniC_Universal_Exception`
+						index++; // erase this line
+					} // end "#undef"
+
+
+					// `#include "file"`, relative to the directory of this file
+					else if (line._Starts_with("#include "))
+					{
+						if (_stats) _stats->_directives++; // the time is in reading and scanning the file
+						std::size_t pos = 9;
+						while (pos < size && line[pos] == ' ') pos++;
+						const std::size_t close = pos < size && line[pos] == '"' ? line.find('"', pos + 1) : std::string_view::npos;
+						if (close == std::string_view::npos)
+							throw MiniC_Universal_Exception{ "Expected \"file\" after \"#include\"", line_num, pos };
+						index++; // erase this line
+						include(line.substr(pos + 1, close - pos - 1), file_name, line_num, pos);
+					} // end "#include"
+
+
+					// "#pragma once" is found when the file is cached, other pragmas are ignored
+					else if (line._Starts_with("#pragma "))
+					{
+						const phase_timer timer = directive_phase();
+						index++; // erase this line
+					} // end "#pragma"
+
+
+					// may replace
+					else
+					{
+						// the last line of an included file is followed by the including file
+						const bool change_line = !top_level || index + 1 != count;
+						index++;
+						const phase_timer timer = phase(&PreprocessStats::_expand_ms);
+						macros.replace(line, line_num, change_line, emit, _trace); // throw MiniC_Universal_Exception
+					} // end macro replace
+
+				} // end preprocess
+
+				if (!conds.empty())
+					throw MiniC_Universal_Exception{ "Unterminated \"#if\"", conds.back()._line, 0 };
+			}
+
+			void start_line(std::size_t line_num, std::uint32_t file)
+			{
+				if (!_at_line_start) return;
+				if (_result._file_ranges.empty() || _result._file_ranges.back()._file != file)
+					_result._file_ranges.push_back(ExpandedSource::file_range{ _result._lines.size(), file });
+				_result._lines.push_back(line_num);
+				_at_line_start = false;
+			}
+
+		private:
+			static constexpr std::size_t max_include_depth = 200;
+
+			// record the expansions at the end of `_text`
+			struct trace_t
+			{
+				ExpandedSource& _result;
+				PreprocessStats* _stats;
+				std::size_t _depth = 0;
+				void enter(std::string_view macro, std::size_t column, std::size_t size)
+				{
+					_result._expansions.enter(macro, _result._text.size(), column, size);
+					if (_stats == nullptr) return;
+					_stats->_expansions[std::string(macro)]++;
+					_stats->_max_depth = std::max(_stats->_max_depth, ++_depth);
+				}
+				void leave()
+				{
+					_result._expansions.leave(_result._text.size());
+					if (_stats) _depth--;
+				}
+			};
+
+			phase_timer phase(double PreprocessStats::* ms) const { return phase_timer{ _stats ? &(_stats->*ms) : nullptr }; }
+
+			phase_timer directive_phase() const
+			{
+				if (_stats) _stats->_directives++;
+				return phase(&PreprocessStats::_directive_ms);
+			}
+
+			Macros& _macros;
+			ExpandedSource& _result;
+			PreprocessStats* _stats;
+			trace_t _trace;
+			bool _at_line_start = true;
+			bool _failed = false;
+			std::size_t _depth = 0;                         // of "#include"
+			std::unordered_set<std::string> _once;          // included files with "#pragma once"
+			std::unordered_map<std::string, std::uint32_t> _file_indices;
+			// "file\nname" of "#include" -> the path and the content
+			std::unordered_map<std::string, std::pair<std::string, std::shared_ptr<const CachedFile>>> _included;
+			std::string _key;
+
+			std::uint32_t file_index(const std::string& file_name)
+			{
+				auto it = _file_indices.try_emplace(file_name, static_cast<std::uint32_t>(_result._files.size())).first;
+				if (it->second == _result._files.size()) _result._files.push_back(file_name);
+				return it->second;
+			}
+
+			// a file included again costs one lookup, if it has "#pragma once" or an include guard
+			void include(std::string_view name, const std::string& from, std::size_t line_num, std::size_t pos)
+			{
+				_key.assign(from).push_back('\n');
+				_key.append(name);
+				auto it = _included.find(_key);
+				if (it == _included.end())
+				{
+					const phase_timer timer = phase(&PreprocessStats::_read_ms);
+					std::string path = (std::filesystem::path(from).parent_path() / std::string(name))
+						.lexically_normal().string();
+					auto file = FileCache::instance().get(path);
+					if (!file)
+						throw MiniC_Universal_Exception{ "failed to open: \"" + path + "\"", line_num, pos };
+					it = _included.try_emplace(_key, std::move(path), std::move(file)).first;
+					if (_stats) _stats->_bytes_in += it->second.second->_source.size();
+				}
+				const std::string& path = it->second.first;
+				const std::shared_ptr<const CachedFile> file = it->second.second;
+				if (file->_once && !_once.insert(path).second) return;
+				if (!file->_guard.empty() && _macros.is_defined(file->_guard)) return;
+				if (_depth == max_include_depth)
+					throw MiniC_Universal_Exception{
+						"\"#include\" is nested deeper than " + std::to_string(max_include_depth) + " levels",
+						line_num, pos };
+
+				_depth++;
+				try {
+					if (file->_invalid_utf8.first != 0)
+						throw MiniC_Universal_Exception{ "invalid UTF-8", file->_invalid_utf8.first, file->_invalid_utf8.second };
+					if (file->_open_comment.first != 0)
+						throw MiniC_Universal_Exception{ "Unterminated comment", file->_open_comment.first, file->_open_comment.second };
+					scan(file->_lines, path, false);
+				}
+				catch (const MiniC_Universal_Exception& e) {
+					if (_failed) throw; // named by the innermost file already
+					_failed = true;
+					std::ostringstream os;
+					os << "In \"" << path << "\": " << e << ", included";
+					throw MiniC_Universal_Exception{ os.str(), line_num, pos };
+				}
+				_depth--;
+			}
+		}; // end class Scanner;
+
+	} // end anonymous namespace
+
+
+	void clear_file_cache() { FileCache::instance().clear(); }
+
+
+	/*
+	 * "NAME=value" is "#define NAME value", the same parser is used,
+	 * a macro with the same name (maybe from a snapshot) is replaced.
+	 */
+	void PreprocessContext::predefine(const std::string& definition)
+	{
+		const std::size_t equal = definition.find('=');
+		const std::string name = definition.substr(0, equal);
+		const std::string value = equal == std::string::npos ? "1" : definition.substr(equal + 1);
+		const auto p = get_identifier(name, 0);
+		if (p.second == -1)
+			throw MiniC_Universal_Exception{ "Expected identifier in \"-D" + definition + "\"", 0, 0 };
+
+		if (_macros->is_defined(p.first))
+			_macros->undef_macro(std::string(p.first), 0, 0);
+		const std::string line = "#define " + name + " " + value;
+		ExpandedSource unused;
+		Scanner{ *_macros, unused }.scan(std::vector<std::string_view>{ line }, "<command line>", true);
+	}
+
+	void PreprocessContext::save_macros(std::ostream& out) const { _macros->save(out); }
+
+	// O(size), no text is parsed again
+	void PreprocessContext::load_macros(std::istream& in)
+	{
+		std::ostringstream content;
+		content << in.rdbuf();
+		_macros->load(content.str());
+	}
+
+
+	void PreprocessContext::preprocess_file(const std::string& file_name, ExpandedSource& result)
+	{
+		PreprocessStats* stats = _collect_stats ? &_stats : nullptr;
+		const auto start = std::chrono::steady_clock::now();
+		util::SourceBuffer source;
+		{
+			const phase_timer timer{ stats ? &stats->_read_ms : nullptr };
+			if (!source.open(file_name))
+				throw MiniC_Universal_Exception{ "failed to open: \"" + file_name + "\"", 0, 0 };
+		}
+
+		const auto invalid_utf8 = find_invalid_utf8(source);
+		if (invalid_utf8.first != 0)
+			throw MiniC_Universal_Exception{ "invalid UTF-8", invalid_utf8.first, invalid_utf8.second };
+
+		// lines are viewed in place, only a line with code after a comment is copied
+		std::vector<std::string_view> lines;
+		for (std::string_view line : source.lines())
+			lines.push_back(line);
+		std::deque<std::string> stripped;
+		const auto open_comment = strip_comments(lines, stripped);
+		if (open_comment.first != 0)
+			throw MiniC_Universal_Exception{ "Unterminated comment", open_comment.first, open_comment.second };
+
+		result._text.clear();
+		result._lines.clear();
+		result._files.clear();
+		result._file_ranges.clear();
+		result._expansions.clear();
+		result._text.reserve(source.size());
+		result._lines.reserve(lines.size());
+
+		const std::size_t hits = _macros->_cache_hits, misses = _macros->_cache_misses;
+		Scanner scanner{ *_macros, result, stats };
+		scanner.scan(lines, file_name, true);
+
+		// the program ends with an empty line
+		scanner.start_line(lines.size(), 0);
+		result._expansions.finish();
+
+		if (stats)
+		{
+			stats->_bytes_in += source.size();
+			stats->_bytes_out += result._text.size();
+			stats->_cache_hits += _macros->_cache_hits - hits;
+			stats->_cache_misses += _macros->_cache_misses - misses;
+			stats->_total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+	} // end function preprocess_file();
+
+
+	void preprocess(const std::string& file_name, std::ostream& out, ExpandedSource& result)
+	{
+		PreprocessContext context;
+		context.preprocess(file_name, result);
+		context.print(out);
+	}
+
+
+	/*
+	 * every file has its own context, so the files share nothing,
+	 * the workers take the next file from a shared counter.
+	 */
+	std::vector<PreprocessedFile> preprocess_files(const std::vector<std::string>& file_names, std::size_t threads)
+	{
+		std::vector<PreprocessedFile> results(file_names.size());
+		if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+		threads = std::min(threads, file_names.size());
+
+		std::atomic<std::size_t> next{ 0 };
+		auto work = [&]() {
+			for (std::size_t i = next++; i < file_names.size(); i = next++)
+			{
+				PreprocessedFile& file = results[i];
+				file._file_name = file_names[i];
+				PreprocessContext context;
+				// nothing may escape a worker thread, it would terminate the process with the whole batch
+				try {
+					try { context.preprocess(file._file_name, file._source); }
+					catch (const MiniC_Universal_Exception&) {}
+					file._diagnostics = context.diagnostics();
+				}
+				catch (const std::exception& e) { file._diagnostics.push_back(file._file_name + ": " + e.what()); }
+				catch (...) { file._diagnostics.push_back(file._file_name + ": unknown error"); }
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (std::size_t i = 1; i < threads; i++) workers.emplace_back(work);
+		work(); // the calling thread is a worker too
+		for (auto& worker : workers) worker.join();
+		return results;
+	}
+
+
+	/*
+	 * return a new file which makes the replacement of macros
+	 */
+	[[nodiscard]] const std::string preprocess(const std::string& file_name, std::ostream& out)
+	{
+		ExpandedSource result;
+		preprocess(file_name, out, result);
 
 		// assume the program is "xxx.txt"
 		const std::string out_file = std::string{ file_name }.replace(
@@ -660,11 +2293,7 @@ namespace Mini_C::preprocess
 			exit(0);
 		}
 
-		for (auto const& line : lines)
-		{
-			outputFile << std::get<0>(line);
-			if (std::get<2>(line)) outputFile << "\n";
-		}
+		outputFile << result._text;
 
 		outputFile.close();
 
@@ -673,4 +2302,4 @@ namespace Mini_C::preprocess
 	} // end function preprocess();
 
 
-} // end namespace Mini_C::preprocess
\ No newline at end of file
+} // end namespace Mini_C::preprocess
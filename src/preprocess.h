@@ -2,13 +2,235 @@
 #ifndef _PREPROCESS_H
 #define _PREPROCESS_H
 #include <string>
+#include <vector>
 #include <iostream>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
 
 namespace Mini_C::preprocess
 {
 
+	/*
+	 * the macro expansions in `ExpandedSource::_text`.
+	 *     each expansion is a range of `_text`, the ranges nest as the expansions do.
+	 *     the entries are ordered by begin, each one is 5 varints:
+	 *         begin - begin of the previous entry, size, index in `_macros`, call column, call size
+	 *     the call column and size locate the replaced text "foo(a, b)" in its original line,
+	 *     they are 0 for the macros expanded from other macros.
+	 *     the nesting is not stored, it is found again when decoding.
+	 *     every `checkpoint_step` entries a checkpoint keeps the state of the decoding,
+	 *     so a lookup decodes from the last checkpoint before the offset, not from the first entry.
+	 */
+	class ExpansionMap
+	{
+	public:
+		struct expansion_t
+		{
+			std::size_t _begin, _end; // in `_text`
+			std::string_view _macro;
+			std::size_t _call_column, _call_size;
+		};
+
+		// the expansions containing `offset`, the outermost first, O(log(entries) + checkpoint_step + depth)
+		[[nodiscard]] std::vector<expansion_t> stack_at(std::size_t offset) const;
+
+		// the last outermost expansion which ends at or before `offset`, false if there is none, as fast as `stack_at()`
+		bool last_before(std::size_t offset, expansion_t& result) const;
+
+		std::size_t size() const { return _count; }
+		std::size_t bytes() const { return _bytes.size(); }
+
+		// build, `enter()` and `leave()` are paired as the expansions nest
+		void enter(std::string_view macro, std::size_t begin, std::size_t call_column, std::size_t call_size);
+		void leave(std::size_t end);
+		void finish(); // encode the entries
+		void clear();
+
+	private:
+		struct pending_t
+		{
+			std::size_t _begin, _end;
+			std::uint32_t _macro;
+			std::size_t _call_column, _call_size;
+		};
+
+		// an entry with its index in the order of the entries
+		struct indexed_t
+		{
+			std::size_t _index;
+			pending_t _entry;
+		};
+
+		/*
+		 * the decoding before the entry which begins at `_entry_begin`:
+		 *     _pos, _base : its place in `_bytes`, the begin of the entry before it
+		 *     _open       : the entries before it which contain its begin, `_open_stacks[_open, _open_end)`
+		 *     _settled    : the last entry before it with a call size which ends at or before its begin
+		 */
+		struct checkpoint_t
+		{
+			std::size_t _entry_begin;
+			std::size_t _pos, _base;
+			std::size_t _open, _open_end;
+			bool _has_settled;
+			indexed_t _settled;
+		};
+		static constexpr std::size_t checkpoint_step = 64;
+
+		// the checkpoint to decode `offset` from, nullptr to decode from the first entry
+		const checkpoint_t* checkpoint_for(std::size_t offset) const;
+		expansion_t entry_of(const pending_t& entry) const;
+
+		std::vector<std::string> _macros;
+		std::string _bytes;
+		std::size_t _count = 0;
+		std::vector<checkpoint_t> _checkpoints;
+		std::vector<indexed_t> _open_stacks;
+
+		// only while building
+		std::unordered_map<std::string, std::uint32_t> _macro_indices;
+		std::vector<pending_t> _pending;
+		std::vector<std::size_t> _open;
+	};
+
+
+	/*
+	 * program after preprocessing, kept in memory.
+	 *     _text        : expanded program, lines are separated by '\n'.
+	 *     _lines       : `_lines[i]` is the line number in the original file
+	 *                    of the i-th line in `_text`.
+	 *     _files       : the main file and the included files, the main file is `_files[0]`.
+	 *     _file_ranges : lines from `_first_line` to the next range are from `_files[_file]`.
+	 *     _expansions  : where the macros are expanded in `_text`.
+	 */
+	struct ExpandedSource
+	{
+		struct file_range
+		{
+			std::size_t _first_line;
+			std::uint32_t _file;
+		};
+
+		std::string _text;
+		std::vector<std::size_t> _lines;
+		std::vector<std::string> _files;
+		std::vector<file_range> _file_ranges;
+		ExpansionMap _expansions;
+
+		// name of the file which the i-th line in `_text` comes from
+		const std::string& file_of(std::size_t line) const
+		{
+			auto it = std::upper_bound(_file_ranges.begin(), _file_ranges.end(), line,
+				[](std::size_t line, const file_range& range) { return line < range._first_line; });
+			return _files[it == _file_ranges.begin() ? 0 : std::prev(it)->_file];
+		}
+	};
+
+	/*
+	 * what `PreprocessContext::preprocess()` did, summed over the calls since `collect_stats(true)`.
+	 *     _lines         : lines of all the files read, the included ones too
+	 *     _directives    : "#define", "#if", "#include", ... handled, the skipped ones are not
+	 *     _skipped_lines : lines dropped by a false "#if"
+	 *     _expansions    : macro name -> times expanded, from other macros too
+	 *     _max_depth     : deepest nesting of macro expansions
+	 *     _cache_*       : outermost function macros replayed from the expansion cache or not
+	 *     *_ms           : time of reading files, of directives, of expanding lines, and the whole
+	 */
+	struct PreprocessStats
+	{
+		std::size_t _files = 0, _lines = 0, _directives = 0, _skipped_lines = 0;
+		std::size_t _bytes_in = 0, _bytes_out = 0;
+		std::size_t _max_depth = 0, _cache_hits = 0, _cache_misses = 0;
+		std::unordered_map<std::string, std::size_t> _expansions;
+		double _read_ms = 0, _directive_ms = 0, _expand_ms = 0, _total_ms = 0;
+
+		// one JSON object, for the build dashboards
+		void write_json(std::ostream& out) const;
+	};
+
+	class Macros;
+
+	/*
+	 * state of preprocessing: the macro table and the diagnostics.
+	 *     contexts share nothing, so different contexts may run on different threads,
+	 *     one context is used by one thread at a time.
+	 */
+	class PreprocessContext
+	{
+	public:
+		PreprocessContext();
+		~PreprocessContext();
+		PreprocessContext(const PreprocessContext&) = delete;
+		PreprocessContext& operator=(const PreprocessContext&) = delete;
+
+		// throw MiniC_Universal_Exception, which is also kept in `diagnostics()`
+		void preprocess(const std::string& file_name, ExpandedSource& result);
+
+		// a macro expanding to text with more nested macros than `depth` is an error, 256 by default
+		void set_max_expansion_depth(std::size_t depth);
+
+		// "NAME", "NAME=value" or "NAME(a, b)=value" as "-D" of the command line, "NAME" is defined as 1
+		// throw MiniC_Universal_Exception
+		void predefine(const std::string& definition);
+
+		/*
+		 * binary snapshot of the macro table, with the compiled replace lines,
+		 * so loading it parses no text. `predefine()` after loading overrides the loaded macros.
+		 * throw MiniC_Universal_Exception for a broken snapshot, or a macro defined already.
+		 */
+		void save_macros(std::ostream& out) const;
+		void load_macros(std::istream& in);
+
+		// outermost function macros used again with the same params are replayed from a cache
+		struct cache_stats_t
+		{
+			std::size_t _hits;
+			std::size_t _misses;
+			double hit_rate() const { return _hits + _misses == 0 ? 0 : double(_hits) / (_hits + _misses); }
+		};
+		cache_stats_t expansion_cache_stats() const;
+
+		// off by default, enabling (or disabling) drops the stats collected before
+		void collect_stats(bool enable);
+		const PreprocessStats& stats() const { return _stats; }
+
+		// for debug, print the macro table
+		void print(std::ostream& out) const;
+
+		const std::vector<std::string>& diagnostics() const { return _diagnostics; }
+
+	private:
+		void preprocess_file(const std::string& file_name, ExpandedSource& result);
+
+		std::unique_ptr<Macros> _macros;
+		std::vector<std::string> _diagnostics;
+		bool _collect_stats = false;
+		PreprocessStats _stats;
+	};
+
+	struct PreprocessedFile
+	{
+		std::string _file_name;
+		ExpandedSource _source;
+		std::vector<std::string> _diagnostics;
+		bool ok() const { return _diagnostics.empty(); }
+	};
+
 	[[nodiscard]] const std::string preprocess(const std::string& file_name, std::ostream&);
 
+	// no temporary file is written, `Lexer::tokenize(result)` consumes it directly
+	void preprocess(const std::string& file_name, std::ostream&, ExpandedSource& result);
+
+	// files read by "#include" are cached for the whole process, drop them if they may have changed
+	void clear_file_cache();
+
+	// preprocess independent files on `threads` threads (0: one per core), results are in the order of `file_names`,
+	// any exception of a file, not only the errors of the program, goes into its `_diagnostics`
+	[[nodiscard]] std::vector<PreprocessedFile> preprocess_files(const std::vector<std::string>& file_names, std::size_t threads = 0);
+
 } // end namespace Mini_C::preprocess
 
-#endif // !_PREPROCESS_H
\ No newline at end of file
+#endif // !_PREPROCESS_H
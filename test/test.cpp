@@ -34,23 +34,23 @@ namespace Mini_C::TEST
 		Mini_C::lexer::numeric_type num_t = std::get<const Mini_C::lexer::numeric_type>(_num);
 
 		if (num_t == Mini_C::lexer::numeric_type::U32)
-			out << static_cast<std::size_t>(std::get<0>(_num));
+			out << lexer::numeric_cast<std::size_t>(_num);
 
 		else if (num_t == Mini_C::lexer::numeric_type::F32 || num_t == Mini_C::lexer::numeric_type::F64)
-			out << static_cast<double>(std::get<0>(_num));
+			out << lexer::numeric_cast<double>(_num);
 
 		else if (num_t == Mini_C::lexer::numeric_type::CHAR)
 		{
-			const char c = static_cast<char>(std::get<0>(_num));
+			const char c = lexer::numeric_cast<char>(_num);
 			if (auto it = escapingMap.find(c); it != escapingMap.end())
 				out << it->second;
 			else out << std::string("'") + c + "'";
 		}
 
 		else if (num_t == Mini_C::lexer::numeric_type::BOOLEAN)
-			out << (static_cast<std::size_t>(std::get<0>(_num)) ? "true" : "false");
+			out << (lexer::numeric_cast<bool>(_num) ? "true" : "false");
 
-		else out << static_cast<int>(std::get<0>(_num));
+		else out << lexer::numeric_cast<int>(_num);
 	}
 
 
@@ -72,16 +72,20 @@ namespace Mini_C::TEST
 	}
 
 
-	void outputToken(const lexer::Token& token, std::ostream& out)
+	void outputToken(const lexer::Lexer& lexer, const lexer::Token& token, std::ostream& out)
 	{
-		out << "In line: " << token._line << ", pos: " << token._pos << ", ";
-		output_token_t(token._token, out);
+		const lexer::SourceLocation loc = lexer.resolve(token._loc);
+		out << "In " << loc._file << " line: " << loc._line << ", pos: " << loc._column;
+		for (auto const& macro : loc._macros)
+			out << ", expanded from " << macro;
+		out << ", ";
+		output_token_t(lexer.tokens().value_of(token), out);
 	}
 
-	void outputTokenVector(const std::vector<lexer::Token>& tokens, std::ostream& out)
+	void outputTokenVector(const lexer::Lexer& lexer, const std::vector<lexer::Token>& tokens, std::ostream& out)
 	{
 		for (auto const& token : tokens)
-			outputToken(token, out);
+			outputToken(lexer, token, out);
 	}
 
 	/*
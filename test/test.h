@@ -34,8 +34,11 @@ namespace Mini_C::TEST
 	void outputLexVector(const std::vector<Mini_C::lexer::token_info> &result, std::ostream&);
 
 
-	void outputToken(const lexer::Token& token, std::ostream&);
-	void outputTokenVector(const std::vector<lexer::Token>& tokens, std::ostream&);
+	/*
+	 * output tokens with the places in the original file, `lexer` is the one which makes them.
+	 */
+	void outputToken(const lexer::Lexer& lexer, const lexer::Token& token, std::ostream&);
+	void outputTokenVector(const lexer::Lexer& lexer, const std::vector<lexer::Token>& tokens, std::ostream&);
 
 
 	/*
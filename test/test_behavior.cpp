@@ -0,0 +1,396 @@
+#ifdef BEHAVIOR_TEST
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cctype>
+#include "../src/lexer.h"
+#include "../src/preprocess.h"
+#include "../src/miniC_exception.h"
+
+std::ostringstream parser_trace;
+#define out parser_trace
+#include "../src/lr1_driver.hpp"
+#undef out
+
+/*
+ * small cases with the expected output, the process exits with the number of failed cases.
+ *     the preprocessor: conditions, errors of "#if", "#include", snapshots, the expansion cache, comments.
+ *     the lexer: `edit()` against a whole `tokenize_text()`, the table of names, the values of streamed tokens,
+ *                recovered errors, keywords, comments.
+ *     the parser: the errors reported by the drivers of lr1.hpp.
+ */
+namespace
+{
+
+	std::size_t failures = 0;
+
+	void write_file(const std::string& file_name, const std::string& content)
+	{
+		std::ofstream os{ file_name, std::ios::out | std::ios::trunc | std::ios::binary };
+		os << content;
+	}
+
+	void check(const std::string& name, const std::string& got, const std::string& expected)
+	{
+		if (got == expected) return;
+		failures++;
+		std::cout << "FAILED: " << name << "\n\texpected: " << expected << "\n\tgot:      " << got << std::endl;
+	}
+
+	// the expanded text, or the error
+	std::string expand(const std::string& content, Mini_C::preprocess::PreprocessContext& context)
+	{
+		write_file("behavior_main.txt", content);
+		Mini_C::preprocess::ExpandedSource result;
+		try { context.preprocess("behavior_main.txt", result); }
+		catch (const Mini_C::MiniC_Universal_Exception& e)
+		{
+			std::ostringstream os;
+			os << "error: " << e;
+			return os.str();
+		}
+		return result._text;
+	}
+
+	std::string expand(const std::string& content)
+	{
+		Mini_C::preprocess::PreprocessContext context;
+		return expand(content, context);
+	}
+
+	// each token as "type value line:pos", an `ERROR` with its diagnostic
+	std::string dump(const Mini_C::lexer::Lexer& lexer)
+	{
+		using namespace Mini_C::lexer;
+		std::ostringstream os;
+		for (std::size_t i = 0; i < lexer.size(); i++)
+		{
+			const Token token = lexer[i];
+			os << type2str(token._type);
+			if (token._type == type::IDENTIFIER) os << " " << lexer.tokens().identifier_of(token);
+			else if (token._type == type::NUMBER_CONSTANT) os << " " << numeric_cast<double>(lexer.tokens().number_of(token));
+			else if (token._type == type::STR_LITERAL) os << " \"" << lexer.tokens().literal_of(token) << "\"";
+			else if (token._type == type::ERROR) os << " (" << lexer.diagnostics()[token._payload]._msg << ")";
+			os << " " << lexer.line_of(token._loc) << ":" << lexer.pos_of(token._loc) << "; ";
+		}
+		return os.str();
+	}
+
+	void test_conditions()
+	{
+		check("nested #if", expand(
+			"#define A 2\n"
+			"#if A > 1\n"
+			"#if defined(B)\n"
+			"b\n"
+			"#elif A == 2\n"
+			"#ifdef A\n"
+			"a2\n"
+			"#else\n"
+			"no_a\n"
+			"#endif\n"
+			"#else\n"
+			"other\n"
+			"#endif\n"
+			"#else\n"
+			"outer_else\n"
+			"#endif\n"
+			"end\n"), "a2\nend\n");
+		check("#elif after a taken branch", expand("#if 1\none\n#elif 1\ntwo\n#else\nthree\n#endif\n"), "one\n");
+		check("integer division", expand("#if 1/2\nhalf\n#elif 3/2 == 1\nint\n#endif\n"), "int\n");
+		check("float division", expand("#if 1.0/2\nhalf\n#endif\n"), "half\n");
+		check("shift and modulo", expand("#if (1 << 62) > 0 && -7 % 3 == -1\nyes\n#endif\n"), "yes\n");
+	}
+
+	void test_condition_errors()
+	{
+		check("modulo by a truncated 0", expand("#if 5 % 0.5\n#endif\n"), "error: Division by zero in the condition in the line: 1, at position: 4");
+		check("division by zero", expand("#if 1 / (2 - 2)\n#endif\n"), "error: Division by zero in the condition in the line: 1, at position: 4");
+		check("shift too far", expand("#if 1 << 70\n#endif\n"), "error: The shift is out of [0, 64) in the condition in the line: 1, at position: 4");
+		check("negative shift", expand("#if 1 >> -1\n#endif\n"), "error: The shift is out of [0, 64) in the condition in the line: 1, at position: 4");
+		check("float out of range", expand("#if 1e30 | 0\n#endif\n"),
+			"error: The value is out of the range of integers in the condition in the line: 1, at position: 4");
+		check("no condition", expand("#if\n#endif\n"), "error: Expected condition after \"#if\" in the line: 1, at position: 4");
+		check("unclosed parenthesis", expand("#if (1\n#endif\n"), "error: Expected \")\" in the condition in the line: 1, at position: 4");
+		check("no #endif", expand("#if 1\nx\n"), "error: Unterminated \"#if\" in the line: 1, at position: 1");
+		check("#else without #if", expand("#else\n"), "error: Unexpected \"#else\" in the line: 1, at position: 1");
+	}
+
+	void test_include()
+	{
+		write_file("behavior_once.txt", "#pragma once\nonce\n");
+		write_file("behavior_guard.txt", "#ifndef BEHAVIOR_GUARD\n#define BEHAVIOR_GUARD\nguarded\n#endif\n");
+		check("#pragma once and include guard", expand(
+			"#include \"behavior_once.txt\"\n"
+			"#include \"behavior_guard.txt\"\n"
+			"#include \"behavior_once.txt\"\n"
+			"#include \"behavior_guard.txt\"\n"
+			"end\n"), "once\nguarded\nend\n");
+		check("missing include", expand("#include \"behavior_missing.txt\"\n"),
+			"error: failed to open: \"behavior_missing.txt\" in the line: 1, at position: 10");
+		Mini_C::preprocess::clear_file_cache();
+	}
+
+	void test_snapshot()
+	{
+		const std::string use = "x = SQUARE(n + 1) + ONE;\n";
+		Mini_C::preprocess::PreprocessContext context;
+		expand("#define ONE 1\n#define SQUARE(a) ((a) * (a))\n", context);
+		const std::string expected = expand(use, context);
+		std::ostringstream out;
+		context.save_macros(out);
+		const std::string snapshot = out.str();
+
+		Mini_C::preprocess::PreprocessContext loaded;
+		std::istringstream in{ snapshot };
+		loaded.load_macros(in);
+		check("snapshot round trip", expand(use, loaded), expected);
+
+		std::string result = "loaded";
+		try
+		{
+			Mini_C::preprocess::PreprocessContext broken;
+			std::istringstream cut{ snapshot.substr(0, snapshot.size() - 3) };
+			broken.load_macros(cut);
+		}
+		catch (const Mini_C::MiniC_Universal_Exception& e)
+		{
+			std::ostringstream os;
+			os << "error: " << e;
+			result = os.str();
+		}
+		check("cut snapshot", result.substr(0, result.find(" in the line")), "error: Broken macro snapshot");
+	}
+
+	/*
+	 * more distinct calls than the expansion cache keeps, with one call repeated between them:
+	 * the repeated one stays cached, and the calls recorded into evicted entries expand right.
+	 */
+	void test_expansion_cache()
+	{
+		std::string content = "#define PAIR(a, b) a + b\n", expected;
+		for (std::size_t i = 0; i < 10000; i++)
+		{
+			content += "PAIR(hot, 1) PAIR(x, " + std::to_string(i) + ")\n";
+			expected += " hot + 1  x + " + std::to_string(i) + "\n";
+		}
+		content += "PAIR(x, 0)\n";
+		expected += " x + 0\n";
+		Mini_C::preprocess::PreprocessContext context;
+		check("expansion cache", expand(content, context), expected);
+		const auto stats = context.expansion_cache_stats();
+		check("expansion cache stats", std::to_string(stats._hits) + " hits " + std::to_string(stats._misses) + " misses",
+			"9999 hits 10002 misses");
+	}
+
+	void test_preprocess_comments()
+	{
+		check("comments", expand("a /* MAX */ b // c\n/*\n#define X 1\n*/ X\n\"// not a comment\"\n"), "a           b\n\n\n   X\n\"// not a comment\"\n");
+		check("unterminated comment", expand("a\n/* b\n"), "error: Unterminated comment in the line: 2, at position: 1");
+	}
+
+	/*
+	 * random edits of a program with comments, strings and errors,
+	 * the tokens and the diagnostics after each edit are the ones of the whole text lexed again.
+	 */
+	void test_edit()
+	{
+		const std::vector<std::string> pieces = {
+			"", " ", "\n", "x", "12", "1.5", "\"s\"", "\"", "/*", "*/", "//", "-", "'c'", "@", "fn f() {}\n",
+		};
+		Mini_C::lexer::Lexer lexer;
+		lexer.recover_errors(true);
+		lexer.tokenize_text("fn main() -> i32 {\n\tlet a = 1 - -2; // one\n\t/* two\n\tthree */ return a;\n\tlet s = \"str\";\n}\n", "edit");
+		std::mt19937 random{ 2019 };
+		for (std::size_t i = 0; i < 2000; i++)
+		{
+			const std::size_t size = lexer.text().size();
+			const std::size_t begin = random() % (size + 1);
+			const std::size_t end = std::min(size, begin + random() % 4);
+			lexer.edit(begin, end, pieces[random() % pieces.size()]);
+
+			Mini_C::lexer::Lexer whole;
+			whole.recover_errors(true);
+			whole.tokenize_text(lexer.text(), "edit");
+			if (dump(lexer) != dump(whole))
+			{
+				check("edit " + std::to_string(i) + " of \"" + lexer.text() + "\"", dump(lexer), dump(whole));
+				return;
+			}
+		}
+	}
+
+	/*
+	 * names typed char by char, each prefix is interned when its line is lexed again,
+	 * the own table of the lexer is built again with the names in use, so it does not grow with the edits.
+	 * lexers given one table share the symbols.
+	 */
+	void test_names()
+	{
+		Mini_C::lexer::Lexer lexer;
+		lexer.tokenize_text("fn main() {\n}\n", "names");
+		std::mt19937 random{ 2019 };
+		std::size_t largest = 0;
+		for (std::size_t i = 0; i < 3000; i++)
+		{
+			std::string line = "let ";
+			for (std::size_t k = 0; k < 8; k++) line += static_cast<char>('a' + random() % 26);
+			line += " = 0;\n";
+			std::size_t at = lexer.text().size() - 2; // before "}\n"
+			for (const char c : line) lexer.edit(at, at, std::string(1, c)), at++;
+			largest = std::max(largest, lexer.names().size());
+		}
+		Mini_C::lexer::Lexer whole;
+		whole.tokenize_text(lexer.text(), "names");
+		check("names after edits", dump(lexer), dump(whole));
+		check("names kept", largest <= 2 * std::max<std::size_t>(whole.names().size(), 1024) ? "bounded" : std::to_string(largest), "bounded");
+
+		Mini_C::util::Interner shared;
+		Mini_C::lexer::Lexer first{ shared }, second{ shared };
+		first.tokenize_text("x y", "first");
+		second.tokenize_text("y z", "second");
+		check("shared names", std::to_string(first[1]._payload) + " " + std::to_string(shared.size()), std::to_string(second[0]._payload) + " 3");
+	}
+
+	/*
+	 * the values of the streamed tokens stay readable after the buffer is refilled, until they are released,
+	 * then the released ones leave the pools.
+	 */
+	void test_stream_values()
+	{
+		std::string text;
+		for (std::size_t i = 0; i < 100; i++) text += "s = \"v" + std::to_string(i) + "\" + " + std::to_string(i) + ";\n";
+		write_file("behavior_main.txt", text);
+
+		Mini_C::lexer::Lexer kept;
+		kept.stream("behavior_main.txt", 3);
+		std::vector<Mini_C::lexer::Token> tokens;
+		for (Mini_C::lexer::Token token; kept.next(token); ) tokens.push_back(token);
+		std::string got, expected;
+		for (std::size_t i = 0; i < 100; i++)
+		{
+			got += kept.tokens().literal_of(tokens[i * 6 + 2]) + " ";
+			got += std::to_string(Mini_C::lexer::numeric_cast<int>(kept.tokens().number_of(tokens[i * 6 + 4]))) + " ";
+			expected += "v" + std::to_string(i) + " " + std::to_string(i) + " ";
+		}
+		check("streamed values kept", got, expected);
+
+		Mini_C::lexer::Lexer released;
+		released.stream("behavior_main.txt", 3);
+		Mini_C::lexer::Token token, literal;
+		released.next(token);
+		released.next(token);
+		released.next(literal);
+		got = released.tokens().literal_of(literal);
+		released.release();
+		while (released.next(token)) released.release();
+		got += released.tokens().value_of(literal).index() == 0 ? " released" : " kept";
+		check("streamed values released", got, "v0 released");
+	}
+
+	void test_recover()
+	{
+		Mini_C::lexer::Lexer lexer;
+		lexer.recover_errors(true);
+		lexer.tokenize_text("let a = 1 @ 2;\nlet s = \"open;\nlet b = $;\n", "recover");
+		check("recovered errors", dump(lexer),
+			"id let 1:0; id a 1:4; = 1:7; num 1 1:9; $error$ (not valid following content\"@\") 1:10; num 2 1:13; ; 1:14; "
+			"id let 2:0; id s 2:4; = 2:7; $error$ (expected a corresponding '\"'\"\n\") 2:14; "
+			"id let 3:0; id b 3:4; = 3:7; $error$ (not a recognizable character.\"$\") 3:8; ; 3:10; ");
+
+		std::string result = "no error";
+		try
+		{
+			Mini_C::lexer::Lexer strict;
+			strict.tokenize_text("let a = 1 @ 2;\n", "strict");
+		}
+		catch (const Mini_C::MiniC_Universal_Exception& e)
+		{
+			std::ostringstream os;
+			os << "error: " << e;
+			result = os.str();
+		}
+		check("first error thrown", result, "error: not valid following content\"@\" in the line: 1, at position: 11");
+	}
+
+	// every keyword of word chars in `keyword_list` lexes to its type, but "true" and "false" are numbers
+	void test_keywords()
+	{
+		using namespace Mini_C::lexer;
+		std::string text, expected;
+		for (const keyword_t& keyword : keyword_list)
+		{
+			if (!std::isalpha(static_cast<unsigned char>(keyword._text[0])) || keyword._text.back() == ']'
+				|| keyword._type == type::TRUE || keyword._type == type::FALSE) continue;
+			text.append(keyword._text).append(" ");
+			expected += type2str(keyword._type) + " ";
+		}
+		Lexer lexer;
+		lexer.tokenize_text(text, "keywords");
+		std::string got;
+		for (std::size_t i = 0; i < lexer.size(); i++) got += type2str(lexer[i]._type) + " ";
+		check("keywords", got, expected);
+	}
+
+	// each error as "message line:pos"
+	std::string parse_errors(const Mini_C::lexer::Lexer& lexer, const std::vector<std::pair<Mini_C::lexer::Token, std::string>>& errors)
+	{
+		std::ostringstream os;
+		for (auto const&[token, msg] : errors)
+			os << msg << " " << lexer.line_of(token._loc) << ":" << lexer.pos_of(token._loc) << "; ";
+		return os.str();
+	}
+
+	// an `ERROR` token is reported by the driver, the same for the whole tokens and the stream
+	void test_parser()
+	{
+		const std::string text = "fn foo(i32 obj) ->i32 {\n\treturn obj @ 2;\n}\n";
+		const std::string expected = "Lexical Error 2:12; Final Position Error 4:0; ";
+		Mini_C::lexer::Lexer lexer;
+		lexer.recover_errors(true);
+		lexer.tokenize_text(text, "parser");
+		check("parser errors", parse_errors(lexer, Mini_C::LR1::analyze(lexer)), expected);
+
+		write_file("behavior_main.txt", text);
+		Mini_C::lexer::Lexer stream;
+		stream.recover_errors(true);
+		stream.stream("behavior_main.txt", 3);
+		check("streamed parser errors", parse_errors(stream, Mini_C::LR1::analyze_stream(stream)), expected);
+	}
+
+	void test_lexer_comments()
+	{
+		Mini_C::lexer::Lexer lexer;
+		lexer.tokenize_text("a /* b\n c */ d // e\n/**/f/* g */h\n", "comments");
+		check("lexer comments", dump(lexer), "id a 1:0; id d 2:6; id f 3:4; id h 3:12; ");
+	}
+
+} // end anonymous namespace
+
+
+int main()
+{
+	test_conditions();
+	test_condition_errors();
+	test_include();
+	test_snapshot();
+	test_expansion_cache();
+	test_preprocess_comments();
+	test_edit();
+	test_names();
+	test_stream_values();
+	test_recover();
+	test_keywords();
+	test_parser();
+	test_lexer_comments();
+	for (const char* file : { "behavior_main.txt", "behavior_once.txt", "behavior_guard.txt" })
+		std::remove(file);
+	std::cout << (failures == 0 ? "all passed" : std::to_string(failures) + " failed") << std::endl;
+	return failures == 0 ? 0 : 1;
+}
+#endif // BEHAVIOR_TEST
@@ -0,0 +1,698 @@
+#ifdef BENCH_TEST
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+#include <unordered_set>
+#include <unordered_map>
+#include <mutex>
+#include <deque>
+#include "../util/char_class.h"
+#include "../util/simd_scan.h"
+#include "../util/interner.h"
+#include "../src/lexer.h"
+#include "../src/preprocess.h"
+#include "../src/miniC_exception.h"
+
+namespace
+{
+
+	const char* bench_file = "bench_input.txt";
+
+	void write_file(const std::string& file_name, const std::string& content)
+	{
+		std::ofstream os{ file_name, std::ios::out | std::ios::trunc | std::ios::binary };
+		os << content;
+	}
+
+	template<typename F>
+	double time_ms(F&& f)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		f();
+		const auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	// tokenize the lines by the former chain of analyzers and by the scanner
+	void lex_both(const std::vector<std::string>& program)
+	{
+		using tokenize_t = decltype(&Mini_C::lexer::tokenize_by_analyzers);
+		std::size_t expected = 0;
+		for (const auto& [name, tokenize] : { std::pair<const char*, tokenize_t>{ "analyzers", &Mini_C::lexer::tokenize_by_analyzers },
+			std::pair<const char*, tokenize_t>{ "dfa      ", &Mini_C::lexer::tokenize } })
+		{
+			std::size_t tokens = 0;
+			const double ms = time_ms([&]() {
+				for (const auto& line : program)
+				{
+					const auto result = tokenize(line.c_str(), line.size());
+					if (const auto* r = std::get_if<std::vector<Mini_C::lexer::token_info>>(&result)) tokens += r->size();
+				}
+			});
+			if (expected != 0 && tokens != expected) std::cout << "\ttoken count differs!" << std::endl;
+			expected = tokens;
+			std::cout << "\t" << name << "\t" << tokens << " tokens\t" << ms << " ms\t" << tokens / (ms * 1e3) << " M tokens/s" << std::endl;
+		}
+	}
+
+} // end anonymous namespace
+
+
+/*
+ * chains of `n` macros, each one expands to the previous one:
+ *     #define M0 0
+ *     #define M1 M0
+ *     ...
+ *     i32 a = Mn;
+ * the time per level should stay flat when `n` grows.
+ */
+void bench_macro_chain()
+{
+	std::cout << "macro chain:" << std::endl;
+	constexpr std::size_t uses = 16;
+	for (const bool function : { false, true })
+		for (std::size_t n = 1000; n <= 32000; n *= 2)
+		{
+			std::ostringstream os;
+			os << "#define M0" << (function ? "(x) x\n" : " 0\n");
+			for (std::size_t i = 1; i <= n; i++)
+				if (function) os << "#define M" << i << "(x) M" << i - 1 << "(x)\n";
+				else os << "#define M" << i << " M" << i - 1 << "\n";
+			for (std::size_t i = 0; i < uses; i++)
+				os << "i32 a" << i << " = M" << n << (function ? "(7)" : "") << ";\n";
+			write_file(bench_file, os.str());
+
+			Mini_C::preprocess::PreprocessContext context;
+			context.set_max_expansion_depth(1 << 20);
+			Mini_C::preprocess::ExpandedSource result;
+			double ms = 0;
+			try { ms = time_ms([&]() { context.preprocess(bench_file, result); }); }
+			catch (const Mini_C::MiniC_Base_Exception& e) { e.printException(); return; }
+			std::cout << "\t" << (function ? "function" : "object  ") << " n = " << n
+				<< "\t" << ms << " ms\t" << ms * 1e6 / (uses * n) << " ns/level" << std::endl;
+		}
+}
+
+
+/*
+ * template-like macros used again and again with the same params,
+ * the second use and later ones are replayed from the expansion cache.
+ */
+void bench_macro_memo()
+{
+	std::cout << "macro memo:" << std::endl;
+	constexpr std::size_t lines = 50000;
+	std::ostringstream os;
+	os << "#define ptr(T) T\n#define pair(T, U) ptr(T) first; ptr(U) second\n"
+		<< "#define field(T, a, b, x) pair(T, T) a; pair(T, x) b\n";
+	for (std::size_t i = 0; i < lines; i++)
+		os << "field(i32, left, right, f64); field(u16, up, down, char);\n";
+	write_file(bench_file, os.str());
+
+	Mini_C::preprocess::PreprocessContext context;
+	Mini_C::preprocess::ExpandedSource result;
+	double ms = 0;
+	try { ms = time_ms([&]() { context.preprocess(bench_file, result); }); }
+	catch (const Mini_C::MiniC_Base_Exception& e) { e.printException(); return; }
+	const auto stats = context.expansion_cache_stats();
+	std::cout << "\t" << 2 * lines << " uses\t" << ms << " ms\thit rate " << stats.hit_rate() * 100 << "%" << std::endl;
+}
+
+
+/*
+ * a handful of macros, and a lot of identifiers which are not macros,
+ * most identifiers should be rejected before looking up the macro table.
+ */
+void bench_macro_filter()
+{
+	std::cout << "macro filter:" << std::endl;
+	constexpr std::size_t lines = 100000;
+	std::ostringstream os;
+	os << "#define MAX 1000\n#define MIN 0\n#define foo_template(T) T\n#define _FUCK_(a) a\n#define LEN 16\n";
+	for (std::size_t i = 0; i < lines; i++)
+		os << "i32 value_" << i << " = count + index * offset - MAX + length_of_the_array;\n";
+	write_file(bench_file, os.str());
+
+	Mini_C::preprocess::PreprocessContext context;
+	Mini_C::preprocess::ExpandedSource result;
+	double ms = 0;
+	try { ms = time_ms([&]() { context.preprocess(bench_file, result); }); }
+	catch (const Mini_C::MiniC_Base_Exception& e) { e.printException(); return; }
+	std::cout << "\t" << lines * 7 << " identifiers\t" << ms << " ms\t"
+		<< os.str().size() / (ms * 1e3) << " MB/s" << std::endl;
+}
+
+
+/*
+ * the same lines, kept or skipped by "#ifdef",
+ * a skipped line should cost next to nothing.
+ */
+void bench_dead_region()
+{
+	std::cout << "dead region:" << std::endl;
+	constexpr std::size_t lines = 100000;
+	for (const bool enabled : { true, false })
+	{
+		std::ostringstream os;
+		if (enabled) os << "#define FEATURE\n";
+		os << "#define twice(a) (a) + (a)\n#ifdef FEATURE\n";
+		for (std::size_t i = 0; i < lines; i++)
+			os << "i32 value_" << i << " = twice(index) - length_of_the_array;\n";
+		os << "#endif\n";
+		write_file(bench_file, os.str());
+
+		Mini_C::preprocess::PreprocessContext context;
+		Mini_C::preprocess::ExpandedSource result;
+		double ms = 0;
+		try { ms = time_ms([&]() { context.preprocess(bench_file, result); }); }
+		catch (const Mini_C::MiniC_Base_Exception& e) { e.printException(); return; }
+		std::cout << "\t" << (enabled ? "enabled " : "disabled") << "\t" << lines << " lines\t" << ms << " ms" << std::endl;
+	}
+}
+
+
+/*
+ * a guarded header and a "#pragma once" header, included again and again,
+ * each include after the first one should be a lookup.
+ */
+void bench_include()
+{
+	std::cout << "include:" << std::endl;
+	constexpr std::size_t header_lines = 1000, includes = 100000;
+	std::ostringstream guarded, once;
+	guarded << "#ifndef BENCH_GUARDED\n#define BENCH_GUARDED\n";
+	once << "#pragma once\n";
+	for (std::size_t i = 0; i < header_lines; i++)
+	{
+		guarded << "i32 guarded_" << i << " = " << i << ";\n";
+		once << "i32 once_" << i << " = " << i << ";\n";
+	}
+	guarded << "#endif\n";
+	write_file("bench_guarded.txt", guarded.str());
+	write_file("bench_once.txt", once.str());
+
+	std::ostringstream os;
+	for (std::size_t i = 0; i < includes; i++)
+		os << "#include \"bench_guarded.txt\"\n#include \"bench_once.txt\"\n";
+	write_file(bench_file, os.str());
+
+	Mini_C::preprocess::PreprocessContext context;
+	Mini_C::preprocess::ExpandedSource result;
+	double ms = 0;
+	try { ms = time_ms([&]() { context.preprocess(bench_file, result); }); }
+	catch (const Mini_C::MiniC_Base_Exception& e) { e.printException(); return; }
+	std::cout << "\t" << 2 * includes << " includes\t" << ms << " ms\t" << ms * 1e6 / (2 * includes) << " ns/include" << std::endl;
+	std::remove("bench_guarded.txt");
+	std::remove("bench_once.txt");
+	Mini_C::preprocess::clear_file_cache();
+}
+
+
+/*
+ * a prelude of many "#define"s, parsed from text or loaded from a snapshot.
+ */
+void bench_macro_snapshot()
+{
+	std::cout << "macro snapshot:" << std::endl;
+	constexpr std::size_t defines = 20000;
+	std::ostringstream os;
+	for (std::size_t i = 0; i < defines; i++)
+		if (i % 2) os << "#define PRELUDE_" << i << "(a, b) ((a) * " << i << " + (b) - PRELUDE_" << i - 1 << ")\n";
+		else os << "#define PRELUDE_" << i << " " << i << " + offset_of_the_prelude\n";
+	write_file(bench_file, os.str());
+
+	std::string snapshot;
+	try
+	{
+		Mini_C::preprocess::PreprocessContext context;
+		Mini_C::preprocess::ExpandedSource result;
+		const double ms = time_ms([&]() { context.preprocess(bench_file, result); });
+		std::ostringstream out;
+		context.save_macros(out);
+		snapshot = out.str();
+		std::cout << "\tparse\t" << defines << " macros\t" << ms << " ms" << std::endl;
+
+		Mini_C::preprocess::PreprocessContext loaded;
+		std::istringstream in{ snapshot };
+		const double load_ms = time_ms([&]() { loaded.load_macros(in); });
+		std::cout << "\tload \t" << snapshot.size() << " bytes\t" << load_ms << " ms" << std::endl;
+	}
+	catch (const Mini_C::MiniC_Base_Exception& e) { e.printException(); }
+}
+
+
+/*
+ * many independent files, each one defines the same macros,
+ * on 1 thread and on all cores.
+ */
+void bench_parallel_files()
+{
+	std::cout << "parallel files:" << std::endl;
+	constexpr std::size_t files = 64, lines = 5000;
+	std::ostringstream os;
+	os << "#define MAX 1000\n#define twice(a) (a) + (a)\n";
+	for (std::size_t i = 0; i < lines; i++)
+		os << "i32 value_" << i << " = twice(index) * MAX - length_of_the_array;\n";
+	std::vector<std::string> file_names;
+	for (std::size_t i = 0; i < files; i++)
+	{
+		file_names.push_back("bench_input_" + std::to_string(i) + ".txt");
+		write_file(file_names.back(), os.str());
+	}
+
+	const std::size_t cores = std::max(1u, std::thread::hardware_concurrency());
+	for (const std::size_t threads : { std::size_t{ 1 }, cores })
+	{
+		std::vector<Mini_C::preprocess::PreprocessedFile> results;
+		const double ms = time_ms([&]() { results = Mini_C::preprocess::preprocess_files(file_names, threads); });
+		for (const auto& result : results)
+			for (const auto& diagnostic : result._diagnostics) std::cout << diagnostic << std::endl;
+		std::cout << "\t" << files << " files, " << threads << " threads\t" << ms << " ms" << std::endl;
+	}
+	for (const auto& file_name : file_names) std::remove(file_name.c_str());
+}
+
+
+/*
+ * the same lines tokenized by the table-driven scanner and by the former chain of analyzers.
+ */
+void bench_lexer_dfa()
+{
+	std::cout << "lexer dfa:" << std::endl;
+	constexpr std::size_t lines = 100000;
+	std::vector<std::string> program;
+	for (std::size_t i = 0; i < lines; i++)
+		program.push_back("if (value_" + std::to_string(i) + " <<= count - 1 && index >= -2.5e3) { ptr->next[i] += "
+			+ std::to_string(i) + "u; name = \"line\"; c = 'x'; } else return -offset;");
+
+	lex_both(program);
+}
+
+
+/*
+ * classify every byte of a program as a divider, a word char or an operator char,
+ * by hash sets (as the lexer used to) and by the flag table.
+ */
+void bench_char_class()
+{
+	std::cout << "char class:" << std::endl;
+	std::string text;
+	while (text.size() < (std::size_t{ 1 } << 24))
+		text += "if (value_1 <<= count - 1 && index >= -2.5e3) { ptr->next[i] += 7u; name = \"line\"; }\n";
+
+	const std::unordered_set<char> dividers = { ' ', '\n', '\t' };
+	const std::unordered_set<char> operators = { '|', '&', '+', '^', '*', '/', '!', '.', ':', '=', '<', '>', '%' };
+	auto in_word = [](char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || (c >= '0' && c <= '9'); };
+	std::size_t counts[2] = {};
+	const double set_ms = time_ms([&]() {
+		std::size_t count = 0;
+		for (const char c : text)
+			count += dividers.count(c) + in_word(c) + operators.count(c);
+		counts[0] = count;
+	});
+	const double table_ms = time_ms([&]() {
+		using Mini_C::util::char_is;
+		namespace char_class = Mini_C::util::char_class;
+		std::size_t count = 0;
+		for (const char c : text)
+			count += char_is(c, char_class::divider) + char_is(c, char_class::word) + char_is(c, char_class::operator_char);
+		counts[1] = count;
+	});
+	if (counts[0] != counts[1]) std::cout << "\tcounts differ!" << std::endl;
+	std::cout << "\thash sets\t" << set_ms * 1e6 / text.size() << " ns/byte" << std::endl
+		<< "\tflag table\t" << table_ms * 1e6 / text.size() << " ns/byte" << std::endl;
+}
+
+
+/*
+ * generated code: long names, indented lines and a big string table,
+ * tokenized with the scalar, SSE2 and AVX2 kernels.
+ */
+void bench_simd_scan()
+{
+	std::cout << "simd scan:" << std::endl;
+	constexpr std::size_t lines = 50000;
+	std::vector<std::string> program;
+	std::size_t bytes = 0;
+	for (std::size_t i = 0; i < lines; i++)
+	{
+		if (i % 2) program.push_back("                table_of_generated_strings_for_the_module_" + std::to_string(i)
+			+ "[index_of_the_entry] = \"the generated message number " + std::to_string(i) + " of the string table, with no escapes at all\";");
+		else program.push_back("        generated_accumulator_variable_" + std::to_string(i)
+			+ " = generated_accumulator_variable_with_a_long_name + another_generated_operand_name;");
+		bytes += program.back().size();
+	}
+
+	using namespace Mini_C::util;
+	for (const simd::level level : { simd::level::scalar, simd::level::sse2, simd::level::avx2 })
+	{
+		if (level > simd::best_level()) break;
+		simd::use_level(level);
+		std::size_t tokens = 0;
+		const double ms = time_ms([&]() {
+			for (const auto& line : program)
+			{
+				const auto result = Mini_C::lexer::tokenize(line.c_str(), line.size());
+				if (const auto* r = std::get_if<std::vector<Mini_C::lexer::token_info>>(&result)) tokens += r->size();
+			}
+		});
+		const char* name = level == simd::level::scalar ? "scalar" : level == simd::level::sse2 ? "sse2  " : "avx2  ";
+		std::cout << "\t" << name << "\t" << tokens << " tokens\t" << ms << " ms\t" << bytes / (ms * 1e3) << " MB/s" << std::endl;
+	}
+	simd::use_default_level();
+}
+
+
+/*
+ * lines of keywords and names only, where the keyword lookup is most of the work.
+ */
+void bench_keywords()
+{
+	std::cout << "keywords:" << std::endl;
+	constexpr std::size_t lines = 100000;
+	std::vector<std::string> program;
+	for (std::size_t i = 0; i < lines; i++)
+		program.push_back("static const i32 value while return synchronized counter_" + std::to_string(i % 100)
+			+ " struct fn if else for typename decltype sizeof node_of_the_list mutex_t lambda");
+	lex_both(program);
+}
+
+
+/*
+ * lines of number literals only: integers, hex, f32 and f64 with exponents.
+ */
+void bench_numbers()
+{
+	std::cout << "numbers:" << std::endl;
+	constexpr std::size_t lines = 100000;
+	std::vector<std::string> program;
+	for (std::size_t i = 0; i < lines; i++)
+		program.push_back("{ " + std::to_string(i) + ", 0x7fff_" + std::to_string(1000 + i % 9000) + ", 3.14159265358979, "
+			+ std::to_string(i) + "u, 6.02214076e23, 1_000_000, 2.5e-3, 0.1, -" + std::to_string(i * 7) + ".125, 1.7976931348623157e308 }");
+	lex_both(program);
+}
+
+
+/*
+ * the tokens of a program kept as records holding the variant (as the lexer used to),
+ * and in the token stream, then read by their terminal ids as the parser does.
+ */
+void bench_token_stream()
+{
+	std::cout << "token stream:" << std::endl;
+	Mini_C::preprocess::ExpandedSource source;
+	for (std::size_t i = 0; i < 100000; i++)
+	{
+		source._text += "if (value_" + std::to_string(i) + " <<= count - 1 && index >= -2.5e3) { ptr->next[i] += "
+			+ std::to_string(i) + "u; name = \"line\"; } else return -offset;\n";
+		source._lines.push_back(i + 1);
+	}
+	source._lines.push_back(source._lines.size() + 1);
+	source._files.push_back("bench");
+
+	std::size_t sums[2] = {};
+	const double variant_ms = time_ms([&]() {
+		std::deque<std::tuple<Mini_C::lexer::SourceLoc, Mini_C::lexer::token_t>> records;
+		std::size_t offset = 0;
+		for (std::size_t begin = 0; begin < source._text.size(); begin = offset)
+		{
+			offset = source._text.find('\n', begin) + 1;
+			const auto result = Mini_C::lexer::tokenize(source._text.c_str() + begin, offset - 1 - begin);
+			for (const auto& token : std::get<std::vector<Mini_C::lexer::token_info>>(result))
+				records.emplace_back(Mini_C::lexer::SourceLoc{ static_cast<std::uint32_t>(begin + std::get<Mini_C::lexer::pos_t>(token)) }, std::get<Mini_C::lexer::token_t>(token));
+		}
+		for (const auto& record : records)
+			sums[0] += static_cast<std::size_t>(std::visit(Mini_C::util::overloaded{
+					[](const Mini_C::lexer::type& type) { return type; },
+					[](const Mini_C::lexer::identifier&) { return Mini_C::lexer::type::IDENTIFIER; },
+					[](const Mini_C::lexer::numeric_t&) { return Mini_C::lexer::type::NUMBER_CONSTANT; },
+					[](const Mini_C::lexer::string_literal_t&) { return Mini_C::lexer::type::STR_LITERAL; },
+				}, std::get<Mini_C::lexer::token_t>(record)));
+	});
+	Mini_C::lexer::Lexer lexer;
+	const double stream_ms = time_ms([&]() {
+		lexer.tokenize(source);
+		for (std::size_t i = 0; i < lexer.size(); i++)
+			sums[1] += static_cast<std::size_t>(lexer[i]._type);
+	});
+	if (sums[0] != sums[1]) std::cout << "\tterminals differ!" << std::endl;
+	std::cout << "\tvariant records\t" << variant_ms << " ms" << std::endl
+		<< "\ttoken stream\t" << stream_ms << " ms\t" << sizeof(Mini_C::lexer::Token) << " bytes/token, " << lexer.size() << " tokens" << std::endl;
+}
+
+
+/*
+ * names seen again and again (as in a program) interned on 4 threads,
+ * by a map under a mutex and by the interner.
+ */
+void bench_interner()
+{
+	std::cout << "interner:" << std::endl;
+	constexpr std::size_t threads = 4, lookups = 1000000;
+	std::vector<std::string> names;
+	for (std::size_t i = 0; i < 5000; i++)
+		names.push_back("name_of_variable_" + std::to_string(i));
+
+	auto run = [&](auto&& intern) {
+		return time_ms([&]() {
+			std::vector<std::thread> workers;
+			for (std::size_t t = 0; t < threads; t++)
+				workers.emplace_back([&, t]() {
+					for (std::size_t i = 0; i < lookups; i++)
+						intern(names[(i * 31 + t * 7) % names.size()]);
+				});
+			for (auto& worker : workers) worker.join();
+		});
+	};
+	std::mutex mutex;
+	std::unordered_map<std::string, std::uint32_t> map;
+	const double map_ms = run([&](const std::string& name) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		return map.emplace(name, static_cast<std::uint32_t>(map.size())).first->second;
+	});
+	Mini_C::util::Interner interner;
+	const double interner_ms = run([&](const std::string& name) { return interner.intern(name); });
+	if (map.size() != interner.size()) std::cout << "\tsizes differ!" << std::endl;
+	std::cout << "\tmap + mutex\t" << map_ms << " ms" << std::endl
+		<< "\tinterner\t" << interner_ms << " ms" << std::endl;
+}
+
+
+/*
+ * a generated file lexed whole into the token stream, and pulled token by token from the streaming lexer.
+ */
+void bench_stream()
+{
+	std::cout << "streaming lexer:" << std::endl;
+	std::string program;
+	for (std::size_t i = 0; program.size() < (std::size_t{ 1 } << 26); i++)
+		program += "fn f_" + std::to_string(i) + "(a: i32, b: f64) -> i32 { if (a <= b * 2.5) return a + " + std::to_string(i) + "; s = \"text\"; }\n";
+	write_file(bench_file, program);
+
+	std::size_t sums[2] = {}, tokens = 0;
+	const double whole_ms = time_ms([&]() {
+		Mini_C::lexer::Lexer lexer;
+		lexer.tokenize(bench_file);
+		for (std::size_t i = 0; i < lexer.size(); i++)
+			sums[0] += static_cast<std::size_t>(lexer[i]._type);
+		tokens = lexer.size();
+	});
+	const double stream_ms = time_ms([&]() {
+		Mini_C::lexer::Lexer lexer;
+		lexer.stream(bench_file);
+		Mini_C::lexer::Token token;
+		while (lexer.next(token))
+		{
+			sums[1] += static_cast<std::size_t>(token._type);
+			lexer.release(); // no value is read
+		}
+	});
+	if (sums[0] != sums[1]) std::cout << "\tterminals differ!" << std::endl;
+	std::cout << "\twhole file\t" << whole_ms << " ms\t" << tokens << " tokens kept" << std::endl
+		<< "\tstreaming\t" << stream_ms << " ms\tabout 4096 tokens kept" << std::endl;
+}
+
+
+/*
+ * the same file lexed by one thread and by chunks on all the cores.
+ */
+void bench_parallel_lexer()
+{
+	std::cout << "parallel lexer:" << std::endl;
+	std::string program;
+	for (std::size_t i = 0; program.size() < (std::size_t{ 1 } << 26); i++)
+		program += "fn f_" + std::to_string(i) + "(a: i32, b: f64) -> i32 { if (a <= b * 2.5) return a - -" + std::to_string(i) + "; s = \"text\"; }\n";
+	write_file(bench_file, program);
+
+	const std::size_t cores = std::max(1u, std::thread::hardware_concurrency());
+	std::size_t expected = 0;
+	for (const std::size_t threads : { std::size_t{ 1 }, cores })
+	{
+		Mini_C::lexer::Lexer lexer;
+		const double ms = time_ms([&]() { lexer.tokenize(bench_file, threads); });
+		if (expected != 0 && lexer.size() != expected) std::cout << "\ttoken count differs!" << std::endl;
+		expected = lexer.size();
+		std::cout << "\t" << threads << " threads\t" << ms << " ms\t" << lexer.size() << " tokens" << std::endl;
+	}
+}
+
+
+void bench_error_recovery()
+{
+	std::cout << "error recovery:" << std::endl;
+	std::string clean, broken;
+	for (std::size_t i = 0; clean.size() < (std::size_t{ 1 } << 24); i++)
+	{
+		const std::string line = "fn f_" + std::to_string(i) + "(a: i32) -> i32 { return a * 2 + " + std::to_string(i) + "; }\n";
+		clean += line;
+		broken += i % 8 == 0 ? "fn g_" + std::to_string(i) + "(a: i32) -> i32 { return a $ 2 + 0x; }\n" : line;
+	}
+	for (const auto& [name, program] : { std::pair<const char*, const std::string&>{ "clean", clean }, { "1/8 lines bad", broken } })
+	{
+		write_file(bench_file, program);
+		Mini_C::lexer::Lexer lexer;
+		lexer.recover_errors(true);
+		const double ms = time_ms([&]() { lexer.tokenize(bench_file); });
+		std::cout << "\t" << name << "\t" << ms << " ms\t" << lexer.size() << " tokens\t" << lexer.diagnostics().size() << " errors" << std::endl;
+	}
+}
+
+/*
+ * a 50k-line file typed into: one char per edit, at a line start,
+ * each edit lexes one line again against the whole file.
+ */
+void bench_incremental_lexer()
+{
+	std::cout << "incremental lexer:" << std::endl;
+	std::string program;
+	for (std::size_t i = 0; i < 50000; i++)
+		program += "fn f_" + std::to_string(i) + "(a: i32) -> i32 { return a * 2 + " + std::to_string(i) + "; }\n";
+
+	Mini_C::lexer::Lexer lexer;
+	lexer.recover_errors(true);
+	constexpr std::size_t edits = 1000, full = 10;
+	const double full_ms = time_ms([&]() {
+		for (std::size_t i = 0; i < full; i++) lexer.tokenize_text(program, bench_file);
+	});
+	const double edit_ms = time_ms([&]() {
+		for (std::size_t i = 0; i < edits; i++)
+		{
+			const std::size_t line = i * 7919 % 50000;
+			lexer.edit(lexer.offset_of(line + 1, 0), lexer.offset_of(line + 1, 0), " ");
+		}
+	});
+
+	Mini_C::lexer::Lexer fresh;
+	fresh.recover_errors(true);
+	fresh.tokenize_text(lexer.text(), bench_file);
+	if (fresh.size() != lexer.size()) std::cout << "\ttoken count differs!" << std::endl;
+	std::cout << "\twhole file\t" << full_ms / full << " ms\tper edit\t" << edit_ms / edits << " ms" << std::endl;
+}
+
+/*
+ * the same code with and without comments, a block comment before each function and one after each statement,
+ * the comments are skipped without being copied, so they should cost little more than their bytes.
+ */
+void bench_comments()
+{
+	std::cout << "comments:" << std::endl;
+	constexpr std::size_t functions = 50000;
+	for (const bool commented : { false, true })
+	{
+		std::ostringstream os;
+		for (std::size_t i = 0; i < functions; i++)
+		{
+			if (commented) os << "/*\n * f_" << i << " doubles its argument, MAX(a, b) is not expanded here\n */\n";
+			os << "fn f_" << i << "(a: i32) -> i32 {\n";
+			os << "\treturn a * 2;" << (commented ? " // twice as large" : "") << "\n}\n";
+		}
+		write_file(bench_file, os.str());
+
+		Mini_C::preprocess::PreprocessContext context;
+		Mini_C::preprocess::ExpandedSource result;
+		Mini_C::lexer::Lexer lexer;
+		double preprocess_ms = 0, lexer_ms = 0;
+		try {
+			preprocess_ms = time_ms([&]() { context.preprocess(bench_file, result); });
+			lexer_ms = time_ms([&]() { lexer.tokenize(bench_file); });
+		}
+		catch (const Mini_C::MiniC_Base_Exception& e) { e.printException(); return; }
+		std::cout << "\t" << (commented ? "commented" : "plain    ") << "\t" << os.str().size() / 1024 << " KB\tpreprocess\t" << preprocess_ms
+			<< " ms\tlexer\t" << lexer_ms << " ms\t" << lexer.size() << " tokens" << std::endl;
+	}
+}
+
+/*
+ * the UTF-8 check on 16 MB of ASCII and of mixed text (2, 3 and 4 byte sequences) with each kernel,
+ * then a file with UTF-8 names and strings lexed, the check is a small part of it.
+ */
+void bench_utf8()
+{
+	std::cout << "utf8:" << std::endl;
+	constexpr std::size_t size = 16 << 20;
+	const std::string ascii_unit = "fn f(a: i32) -> i32 { return a * 2; }\n";
+	const std::string mixed_unit = "let \xc3\xa9t\xc3\xa9 = \"\xe4\xbd\xa0\xe5\xa5\xbd \xf0\x9f\x99\x82\";\n";
+	using namespace Mini_C::util;
+	for (const std::string* unit : { &ascii_unit, &mixed_unit })
+	{
+		std::string text;
+		while (text.size() < size) text += *unit;
+		for (const simd::level level : { simd::level::scalar, simd::level::sse2, simd::level::avx2 })
+		{
+			if (level > simd::best_level()) break;
+			simd::use_level(level);
+			std::size_t valid = 0;
+			const double ms = time_ms([&]() { valid = simd::find_invalid_utf8(text.data(), text.size()); });
+			const char* name = level == simd::level::scalar ? "scalar" : level == simd::level::sse2 ? "sse2  " : "avx2  ";
+			std::cout << "\t" << (unit == &ascii_unit ? "ascii" : "mixed") << "\t" << name << "\t" << (valid == text.size() ? "valid" : "INVALID")
+				<< "\t" << ms << " ms\t" << text.size() / (ms * 1e6) << " GB/s" << std::endl;
+		}
+	}
+	simd::use_default_level();
+
+	constexpr std::size_t functions = 50000;
+	std::ostringstream os;
+	for (std::size_t i = 0; i < functions; i++)
+		os << "fn \xe5\x80\x8d_" << i << "(\xc3\xa9: i32) -> i32 {\n\tlet s = \"\xe4\xb8\xa4\xe5\x80\x8d \xf0\x9f\x99\x82\";\n\treturn \xc3\xa9 * 2;\n}\n";
+	write_file(bench_file, os.str());
+	Mini_C::lexer::Lexer lexer;
+	double lexer_ms = 0;
+	try {
+		lexer_ms = time_ms([&]() { lexer.tokenize(bench_file); });
+	}
+	catch (const Mini_C::MiniC_Base_Exception& e) { e.printException(); return; }
+	std::cout << "\tlexer\t" << os.str().size() / 1024 << " KB\t" << lexer_ms << " ms\t" << lexer.size() << " tokens" << std::endl;
+}
+
+int main()
+{
+	bench_macro_chain();
+	bench_macro_filter();
+	bench_macro_memo();
+	bench_dead_region();
+	bench_include();
+	bench_macro_snapshot();
+	bench_parallel_files();
+	bench_lexer_dfa();
+	bench_char_class();
+	bench_simd_scan();
+	bench_keywords();
+	bench_numbers();
+	bench_token_stream();
+	bench_interner();
+	bench_stream();
+	bench_parallel_lexer();
+	bench_error_recovery();
+	bench_incremental_lexer();
+	bench_comments();
+	bench_utf8();
+	std::remove(bench_file);
+	return 0;
+}
+#endif // BENCH_TEST
@@ -28,7 +28,7 @@ auto ____ = []()
 }();
 #define out os
 #define OUTPUT_DFA
-#include "../src/lr1.hpp"
+#include "../src/lr1_driver.hpp"
 
 void rsy_lexer_test()
 {
@@ -63,7 +63,7 @@ void rsy_lexer_test()
 	for (auto const&[token, str] : error_result)
 	{
 		out << "\n-----------------------------------------\n";
-		Mini_C::TEST::outputToken(token, out);
+		Mini_C::TEST::outputToken(_lexer, token, out);
 		out << str << std::endl;
 	}
 	if (error_result.size() == 0) std::cout << "ok" << std::endl;
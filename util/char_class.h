@@ -0,0 +1,64 @@
+#pragma once
+#ifndef _CHAR_CLASS_H
+#define _CHAR_CLASS_H
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace Mini_C::util
+{
+
+	/*
+	 * classes of the chars, as the lexer and the preprocessor see them.
+	 *     one byte of flags per char in `char_classes`, built at compile time,
+	 *     so a check is one load and one test, whatever the locale is.
+	 *     the bytes >= 0x80 are word chars and nothing else, so a UTF-8 name is a word,
+	 *     the text is checked to be UTF-8 before (`simd::find_invalid_utf8()`), no sequence is decoded.
+	 */
+	namespace char_class
+	{
+		enum : std::uint8_t
+		{
+			divider       = 1 << 0,     // ' ', '\n', '\t'
+			word_begin    = 1 << 1,     // a-z A-Z _, and the bytes of UTF-8 sequences
+			digit         = 1 << 2,     // 0-9
+			hex           = 1 << 3,     // 0-9 a-f A-F
+			operator_char = 1 << 4,     // first char of a combinable operator: "|&+^*/!.:=<>%"
+			operator_next = 1 << 5,     // later char of a combinable operator: "+=|&.:<>"
+			single_symbol = 1 << 6,     // "(){}[];,?"
+			follow_number = 1 << 7,     // may follow a number: "+-*/)]}|&^,:;%=><"
+
+			word = word_begin | digit,
+		};
+	}
+
+	constexpr std::array<std::uint8_t, 256> make_char_classes()
+	{
+		std::array<std::uint8_t, 256> classes{};
+		auto set = [&classes](std::string_view chars, std::uint8_t flag)
+		{
+			for (const char c : chars) classes[static_cast<unsigned char>(c)] |= flag;
+		};
+		set(" \n\t", char_class::divider);
+		set("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_", char_class::word_begin);
+		for (std::size_t c = 0x80; c < 256; c++) classes[c] |= char_class::word_begin;
+		set("0123456789", char_class::digit);
+		set("0123456789abcdefABCDEF", char_class::hex);
+		set("|&+^*/!.:=<>%", char_class::operator_char);
+		set("+=|&.:<>", char_class::operator_next);
+		set("(){}[];,?", char_class::single_symbol);
+		set("+-*/)]}|&^,:;%=><", char_class::follow_number);
+		return classes;
+	}
+
+	inline constexpr std::array<std::uint8_t, 256> char_classes = make_char_classes();
+
+	// `c` has one of `flags`
+	constexpr bool char_is(char c, std::uint8_t flags)
+	{
+		return (char_classes[static_cast<unsigned char>(c)] & flags) != 0;
+	}
+
+} // end namespace Mini_C::util
+
+#endif // !_CHAR_CLASS_H
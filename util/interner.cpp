@@ -0,0 +1,150 @@
+#include "interner.h"
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Mini_C::util
+{
+
+	namespace
+	{
+
+		constexpr std::uint64_t hash_bits = 0xffffffff00000000ull;
+		constexpr std::size_t chars_per_block = 1 << 16;
+
+		inline unsigned last_bit(std::uint64_t value)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanReverse64(&index, value);
+			return index;
+#else
+			return 63 - __builtin_clzll(value);
+#endif
+		}
+
+	} // end anonymous namespace
+
+
+	Interner& symbols()
+	{
+		static Interner interner;
+		return interner;
+	}
+
+
+	Interner::table_t::table_t(std::size_t capacity)
+		:_mask(capacity - 1), _slots(new std::atomic<std::uint64_t>[capacity])
+	{
+		for (std::size_t i = 0; i < capacity; i++)
+			_slots[i].store(0, std::memory_order_relaxed);
+	}
+
+	Interner::Interner()
+	{
+		_tables.push_back(std::make_unique<table_t>(first_segment * 4));
+		_table.store(_tables.back().get(), std::memory_order_release);
+	}
+
+	Interner::~Interner() = default;
+
+	std::string_view Interner::name(symbol_t symbol) const
+	{
+		const std::size_t index = std::size_t{ symbol } + first_segment;
+		const unsigned segment = last_bit(index) - last_bit(first_segment);
+		return _segments[segment].load(std::memory_order_acquire)[index - (first_segment << segment)];
+	}
+
+	bool Interner::find(const table_t& table, std::string_view name, std::uint64_t hash, symbol_t& result) const
+	{
+		for (std::size_t i = hash & table._mask; ; i = (i + 1) & table._mask)
+		{
+			const std::uint64_t slot = table._slots[i].load(std::memory_order_acquire);
+			if (slot == 0) return false;
+			if ((slot & hash_bits) != (hash & hash_bits)) continue;
+			const symbol_t symbol = static_cast<symbol_t>(slot) - 1;
+			if (this->name(symbol) == name)
+			{
+				result = symbol;
+				return true;
+			}
+		}
+	}
+
+	void Interner::place(table_t& table, std::uint64_t hash, symbol_t symbol)
+	{
+		std::size_t i = hash & table._mask;
+		while (table._slots[i].load(std::memory_order_relaxed) != 0) i = (i + 1) & table._mask;
+		table._slots[i].store((hash & hash_bits) | (std::uint64_t{ symbol } + 1), std::memory_order_release);
+	}
+
+	/*
+	 * a new name: its `std::string_view` is written before the slot which leads to it,
+	 * and a table is published only when it is filled, so a reader sees a name completely or not at all.
+	 * a reader in an old table may miss the newest names, then it finds them here under the lock.
+	 */
+	symbol_t Interner::intern(std::string_view name)
+	{
+		const std::uint64_t hash = std::hash<std::string_view>{}(name);
+		symbol_t result;
+		if (find(*_table.load(std::memory_order_acquire), name, hash, result)) return result;
+
+		std::lock_guard<std::mutex> lock{ _mutex };
+		table_t* table = _table.load(std::memory_order_relaxed);
+		if (find(*table, name, hash, result)) return result;
+
+		const std::size_t symbol = _size.load(std::memory_order_relaxed);
+		if (symbol >= UINT32_MAX - first_segment)
+			throw std::length_error("too many names to intern");
+		const std::size_t index = symbol + first_segment;
+		const unsigned segment = last_bit(index) - last_bit(first_segment);
+		if (_segments[segment].load(std::memory_order_relaxed) == nullptr)
+		{
+			_segment_storage.push_back(std::make_unique<std::string_view[]>(first_segment << segment));
+			_segments[segment].store(_segment_storage.back().get(), std::memory_order_release);
+		}
+		_segments[segment].load(std::memory_order_relaxed)[index - (first_segment << segment)] = store(name);
+		_size.store(symbol + 1, std::memory_order_release);
+
+		// at most half full
+		if ((symbol + 1) * 2 > table->_mask + 1)
+		{
+			_tables.push_back(std::make_unique<table_t>((table->_mask + 1) * 2));
+			table_t* const larger = _tables.back().get();
+			for (symbol_t old = 0; old < symbol; old++)
+				place(*larger, std::hash<std::string_view>{}(this->name(old)), old);
+			place(*larger, hash, static_cast<symbol_t>(symbol));
+			_table.store(larger, std::memory_order_release);
+		}
+		else place(*table, hash, static_cast<symbol_t>(symbol));
+		return static_cast<symbol_t>(symbol);
+	}
+
+	/*
+	 * the names are copied into blocks which are never freed or moved,
+	 * a long name gets a block of its own.
+	 */
+	std::string_view Interner::store(std::string_view name)
+	{
+		if (name.size() > chars_per_block / 4)
+		{
+			// before the block being filled, which stays the last
+			const auto block = _chars.insert(_chars.empty() ? _chars.end() : _chars.end() - 1, std::make_unique<char[]>(name.size()));
+			std::memcpy(block->get(), name.data(), name.size());
+			return std::string_view{ block->get(), name.size() };
+		}
+		if (_chars_left < name.size())
+		{
+			_chars.push_back(std::make_unique<char[]>(chars_per_block));
+			_chars_left = chars_per_block;
+		}
+		char* const begin = _chars.back().get() + (chars_per_block - _chars_left);
+		std::memcpy(begin, name.data(), name.size());
+		_chars_left -= name.size();
+		return std::string_view{ begin, name.size() };
+	}
+
+} // end namespace Mini_C::util
@@ -0,0 +1,76 @@
+#pragma once
+#ifndef _INTERNER_H
+#define _INTERNER_H
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace Mini_C::util
+{
+
+	/*
+	 * dense id of an interned name, the ids are given from 0 in the order the names are first seen.
+	 */
+	using symbol_t = std::uint32_t;
+
+	/*
+	 * table of names, a lexer has one of its own unless it is given one to share (see `lexer::Lexer`).
+	 *     a name is interned once, then it is compared and hashed as its `symbol_t`.
+	 *     `intern()` of a name seen before, and `name()`, take no lock,
+	 *     only a new name takes the mutex, so lexers on many threads may share the table.
+	 *     the names are never removed one by one, the `std::string_view`s stay valid until the table is destroyed,
+	 *     the owner drops the names no token uses by building a new table.
+	 */
+	class Interner
+	{
+	public:
+		Interner();
+		~Interner();
+		Interner(const Interner&) = delete;
+		Interner& operator=(const Interner&) = delete;
+
+		symbol_t intern(std::string_view name);
+		std::string_view name(symbol_t symbol) const;
+		std::size_t size() const { return _size.load(std::memory_order_acquire); }
+
+	private:
+		/*
+		 * open addressing, a slot is the high 32 bits of the hash and `symbol + 1`, 0 is empty.
+		 * a full table is copied to one twice as large, the old ones are kept for the readers still in them.
+		 */
+		struct table_t
+		{
+			std::size_t _mask;
+			std::unique_ptr<std::atomic<std::uint64_t>[]> _slots;
+			explicit table_t(std::size_t capacity);
+		};
+
+		// the names by symbol, `_segments[k]` holds `first_segment << k` of them, from symbol `(first_segment << k) - first_segment`
+		static constexpr std::size_t first_segment = 1024;
+
+		bool find(const table_t& table, std::string_view name, std::uint64_t hash, symbol_t& result) const;
+		static void place(table_t& table, std::uint64_t hash, symbol_t symbol);
+		std::string_view store(std::string_view name);
+
+		std::atomic<table_t*> _table;
+		std::array<std::atomic<std::string_view*>, 32> _segments{};
+		std::atomic<std::size_t> _size{ 0 };
+
+		// only with `_mutex`
+		std::mutex _mutex;
+		std::vector<std::unique_ptr<table_t>> _tables;
+		std::vector<std::unique_ptr<std::string_view[]>> _segment_storage;
+		std::vector<std::unique_ptr<char[]>> _chars;
+		std::size_t _chars_left = 0;
+	};
+
+	// the table for the whole process, which `interpret::Env` reads, a lexer of a program to run is given it
+	Interner& symbols();
+
+} // end namespace Mini_C::util
+
+#endif // !_INTERNER_H
@@ -0,0 +1,464 @@
+#include "simd_scan.h"
+#include "char_class.h"
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define MINI_C_SIMD_X86 // SSE2 is always there on x64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MINI_C_TARGET_AVX2
+#else
+#define MINI_C_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace Mini_C::util::simd
+{
+
+	namespace
+	{
+
+		std::size_t skip_dividers_scalar(const char* s, std::size_t pos, std::size_t size)
+		{
+			while (pos < size && char_is(s[pos], char_class::divider)) pos++;
+			return pos;
+		}
+
+		std::size_t skip_word_scalar(const char* s, std::size_t pos, std::size_t size)
+		{
+			while (pos < size && char_is(s[pos], char_class::word)) pos++;
+			return pos;
+		}
+
+		std::size_t find_string_stop_scalar(const char* s, std::size_t pos, std::size_t size)
+		{
+			while (pos < size && s[pos] != '"' && s[pos] != '\\') pos++;
+			return pos;
+		}
+
+		// length of the valid UTF-8 sequence at `pos`, 0 if it is not valid
+		std::size_t utf8_sequence(const char* s, std::size_t pos, std::size_t size)
+		{
+			const unsigned char lead = static_cast<unsigned char>(s[pos]);
+			if (lead < 0x80) return 1;
+			std::size_t length = 0;
+			unsigned char low = 0x80, high = 0xbf;      // of the second byte
+			if (lead >= 0xc2 && lead <= 0xdf) length = 2;
+			else if (lead >= 0xe0 && lead <= 0xef)
+			{
+				length = 3;
+				if (lead == 0xe0) low = 0xa0;           // overlong
+				else if (lead == 0xed) high = 0x9f;     // surrogate
+			}
+			else if (lead >= 0xf0 && lead <= 0xf4)
+			{
+				length = 4;
+				if (lead == 0xf0) low = 0x90;           // overlong
+				else if (lead == 0xf4) high = 0x8f;     // above U+10FFFF
+			}
+			if (length == 0 || pos + length > size) return 0;
+			const unsigned char second = static_cast<unsigned char>(s[pos + 1]);
+			if (second < low || second > high) return 0;
+			for (std::size_t i = 2; i < length; i++)
+				if ((static_cast<unsigned char>(s[pos + i]) & 0xc0) != 0x80) return 0;
+			return length;
+		}
+
+		std::size_t find_invalid_utf8_scalar(const char* s, std::size_t pos, std::size_t size)
+		{
+			while (pos < size)
+			{
+				// 8 ASCII chars at a time
+				std::uint64_t word;
+				if (pos + 8 <= size && (std::memcpy(&word, s + pos, 8), (word & 0x8080808080808080u) == 0))
+				{
+					pos += 8;
+					continue;
+				}
+				const std::size_t length = utf8_sequence(s, pos, size);
+				if (length == 0) return pos;
+				pos += length;
+			}
+			return size;
+		}
+
+
+#ifdef MINI_C_SIMD_X86
+
+		inline unsigned first_bit(std::uint32_t mask)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return index;
+#else
+			return __builtin_ctz(mask);
+#endif
+		}
+
+		/*
+		 * each lane is all 1s if the char is in the class.
+		 * the letters are found as `c | 0x20` in 'a'..'z', the compares are signed,
+		 * so the bytes >= 0x80 are below them, they are word chars by their sign bit.
+		 */
+		inline __m128i dividers_16(__m128i v)
+		{
+			return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+				_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+		}
+
+		inline __m128i word_16(__m128i v)
+		{
+			const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+			const __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+			const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));
+			const __m128i utf8 = _mm_cmplt_epi8(v, _mm_setzero_si128());
+			return _mm_or_si128(_mm_or_si128(letter, digit), _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('_')), utf8));
+		}
+
+		inline __m128i string_stop_16(__m128i v)
+		{
+			return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+		}
+
+		// `Stop` gives the lanes of the chars which end the run
+		template<typename Stop>
+		std::size_t find_16(const char* s, std::size_t pos, std::size_t size, Stop stop)
+		{
+			for (; pos + 16 <= size; pos += 16)
+			{
+				const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + pos));
+				const std::uint32_t mask = static_cast<std::uint32_t>(_mm_movemask_epi8(stop(v)));
+				if (mask != 0) return pos + first_bit(mask);
+			}
+			return pos;
+		}
+
+		std::size_t skip_dividers_sse2(const char* s, std::size_t pos, std::size_t size)
+		{
+			pos = find_16(s, pos, size, [](__m128i v) { return _mm_xor_si128(dividers_16(v), _mm_set1_epi8(-1)); });
+			return skip_dividers_scalar(s, pos, size);
+		}
+
+		std::size_t skip_word_sse2(const char* s, std::size_t pos, std::size_t size)
+		{
+			pos = find_16(s, pos, size, [](__m128i v) { return _mm_xor_si128(word_16(v), _mm_set1_epi8(-1)); });
+			return skip_word_scalar(s, pos, size);
+		}
+
+		std::size_t find_string_stop_sse2(const char* s, std::size_t pos, std::size_t size)
+		{
+			pos = find_16(s, pos, size, string_stop_16);
+			return find_string_stop_scalar(s, pos, size);
+		}
+
+		// a block with a byte >= 0x80 is checked sequence by sequence, a sequence may go into the next block
+		std::size_t find_invalid_utf8_sse2(const char* s, std::size_t pos, std::size_t size)
+		{
+			while (pos + 16 <= size)
+			{
+				const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + pos));
+				if (_mm_movemask_epi8(v) == 0)
+				{
+					pos += 16;
+					continue;
+				}
+				for (const std::size_t end = pos + 16; pos < end; )
+				{
+					const std::size_t length = utf8_sequence(s, pos, size);
+					if (length == 0) return pos;
+					pos += length;
+				}
+			}
+			return find_invalid_utf8_scalar(s, pos, size);
+		}
+
+
+		// the same with 32 chars, the functions are compiled for AVX2 one by one, and only called if the CPU has it
+		MINI_C_TARGET_AVX2 inline __m256i dividers_32(__m256i v)
+		{
+			return _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+		}
+
+		MINI_C_TARGET_AVX2 inline __m256i word_32(__m256i v)
+		{
+			const __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+			const __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+			const __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+			const __m256i utf8 = _mm256_cmpgt_epi8(_mm256_setzero_si256(), v);
+			return _mm256_or_si256(_mm256_or_si256(letter, digit), _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')), utf8));
+		}
+
+		MINI_C_TARGET_AVX2 inline __m256i string_stop_32(__m256i v)
+		{
+			return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+		}
+
+		MINI_C_TARGET_AVX2 std::size_t skip_dividers_avx2(const char* s, std::size_t pos, std::size_t size)
+		{
+			for (; pos + 32 <= size; pos += 32)
+			{
+				const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + pos));
+				const std::uint32_t mask = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(dividers_32(v)));
+				if (mask != 0) return pos + first_bit(mask);
+			}
+			_mm256_zeroupper(); // no penalty when going back to SSE code
+			return skip_dividers_sse2(s, pos, size);
+		}
+
+		MINI_C_TARGET_AVX2 std::size_t skip_word_avx2(const char* s, std::size_t pos, std::size_t size)
+		{
+			for (; pos + 32 <= size; pos += 32)
+			{
+				const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + pos));
+				const std::uint32_t mask = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(word_32(v)));
+				if (mask != 0) return pos + first_bit(mask);
+			}
+			_mm256_zeroupper(); // no penalty when going back to SSE code
+			return skip_word_sse2(s, pos, size);
+		}
+
+		MINI_C_TARGET_AVX2 std::size_t find_string_stop_avx2(const char* s, std::size_t pos, std::size_t size)
+		{
+			for (; pos + 32 <= size; pos += 32)
+			{
+				const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + pos));
+				const std::uint32_t mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(string_stop_32(v)));
+				if (mask != 0) return pos + first_bit(mask);
+			}
+			_mm256_zeroupper(); // no penalty when going back to SSE code
+			return find_string_stop_sse2(s, pos, size);
+		}
+
+		/*
+		 * UTF-8 by table lookups (Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte"):
+		 *     the error flags of a pair of bytes are looked up by the high nibble of the first byte,
+		 *     its low nibble and the high nibble of the second byte, a flag is an error if all the three have it.
+		 *     the 3rd and 4th bytes of a sequence are found from the bytes 2 and 3 before them,
+		 *     they must be continuations, which the lookups flag as two continuations in a row.
+		 */
+		namespace utf8
+		{
+			constexpr std::uint8_t too_short = 1 << 0;     // a lead or ASCII, then a lead
+			constexpr std::uint8_t too_long = 1 << 1;      // ASCII, then a continuation
+			constexpr std::uint8_t overlong_3 = 1 << 2;    // 11100000 100_____
+			constexpr std::uint8_t too_large = 1 << 3;     // above U+10FFFF
+			constexpr std::uint8_t surrogate = 1 << 4;     // 11101101 101_____
+			constexpr std::uint8_t overlong_2 = 1 << 5;    // 1100000_ 10______
+			constexpr std::uint8_t too_large_1000 = 1 << 6;
+			constexpr std::uint8_t overlong_4 = 1 << 6;    // 11110000 1000____
+			constexpr std::uint8_t two_conts = 1 << 7;     // a continuation, then a continuation
+			constexpr std::uint8_t carry = too_short | too_long | two_conts;   // whatever the low nibble of the first byte is
+
+			alignas(16) constexpr std::uint8_t first_high[16] = {
+				too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+				two_conts, two_conts, two_conts, two_conts,
+				too_short | overlong_2,
+				too_short,
+				too_short | overlong_3 | surrogate,
+				too_short | too_large | too_large_1000 | overlong_4,
+			};
+			alignas(16) constexpr std::uint8_t first_low[16] = {
+				carry | overlong_3 | overlong_2 | overlong_4,
+				carry | overlong_2,
+				carry, carry,
+				carry | too_large,
+				carry | too_large | too_large_1000, carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+				carry | too_large | too_large_1000, carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+				carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+				carry | too_large | too_large_1000 | surrogate,
+				carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+			};
+			alignas(16) constexpr std::uint8_t second_high[16] = {
+				too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+				too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 | overlong_4,
+				too_long | overlong_2 | two_conts | overlong_3 | too_large,
+				too_long | overlong_2 | two_conts | surrogate | too_large,
+				too_long | overlong_2 | two_conts | surrogate | too_large,
+				too_short, too_short, too_short, too_short,
+			};
+		}
+
+		MINI_C_TARGET_AVX2 inline __m256i table_32(const std::uint8_t (&table)[16])
+		{
+			return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table)));
+		}
+
+		// the bytes of `input` moved up by `n`, the last `n` bytes of `prev` go in front
+		template<int n>
+		MINI_C_TARGET_AVX2 inline __m256i shift_in(__m256i input, __m256i prev)
+		{
+			return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - n);
+		}
+
+		MINI_C_TARGET_AVX2 inline __m256i utf8_errors_32(__m256i input, __m256i prev)
+		{
+			const __m256i nibble = _mm256_set1_epi8(0x0f);
+			const __m256i prev1 = shift_in<1>(input, prev);
+			const __m256i first_high = _mm256_shuffle_epi8(table_32(utf8::first_high), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+			const __m256i first_low = _mm256_shuffle_epi8(table_32(utf8::first_low), _mm256_and_si256(prev1, nibble));
+			const __m256i second_high = _mm256_shuffle_epi8(table_32(utf8::second_high), _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+			const __m256i special = _mm256_and_si256(_mm256_and_si256(first_high, first_low), second_high);
+
+			// only 111_____ and 1111____ get the high bit
+			const __m256i third = _mm256_subs_epu8(shift_in<2>(input, prev), _mm256_set1_epi8(static_cast<char>(0xe0 - 0x80)));
+			const __m256i fourth = _mm256_subs_epu8(shift_in<3>(input, prev), _mm256_set1_epi8(static_cast<char>(0xf0 - 0x80)));
+			const __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+			return _mm256_xor_si256(must_continue, special);
+		}
+
+		/*
+		 * the tail is checked in a copy, followed by a block of zeros, which finds a sequence cut at the end.
+		 * a block with an error may be blamed for the last bytes of the block before,
+		 * so the bytes are looked at one by one from the block before.
+		 */
+		MINI_C_TARGET_AVX2 std::size_t find_invalid_utf8_avx2(const char* s, std::size_t pos, std::size_t size)
+		{
+			const std::size_t begin = pos;
+			__m256i prev = _mm256_setzero_si256();
+			bool failed = false;
+			for (; pos + 32 <= size && !failed; pos += 32)
+			{
+				const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + pos));
+				const __m256i errors = utf8_errors_32(input, prev);
+				failed = !_mm256_testz_si256(errors, errors);
+				prev = input;
+			}
+			if (!failed)
+			{
+				alignas(32) char tail[64] = {};
+				std::memcpy(tail, s + pos, size - pos);
+				for (std::size_t i = 0; i < sizeof(tail) && !failed; i += 32)
+				{
+					const __m256i input = _mm256_load_si256(reinterpret_cast<const __m256i*>(tail + i));
+					const __m256i errors = utf8_errors_32(input, prev);
+					failed = !_mm256_testz_si256(errors, errors);
+					prev = input;
+				}
+				pos += 32;
+			}
+			_mm256_zeroupper(); // no penalty when going back to SSE code
+			if (!failed) return size;
+
+			// `pos` is after the block with the error
+			std::size_t from = begin;
+			if (pos >= begin + 64)
+				for (from = pos - 64; (static_cast<unsigned char>(s[from]) & 0xc0) == 0x80; from++); // in a valid sequence
+			return find_invalid_utf8_scalar(s, from, size);
+		}
+
+		bool cpu_has_avx2()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) return false;
+			__cpuid(info, 1);
+			const bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6; // OSXSAVE, then XMM and YMM state
+			__cpuidex(info, 7, 0);
+			return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#else
+			__builtin_cpu_init(); // may run before the constructors of libgcc
+			return __builtin_cpu_supports("avx2");
+#endif
+		}
+
+#endif // MINI_C_SIMD_X86
+
+
+		struct kernels_t
+		{
+			level _level;
+			std::size_t(*_skip_dividers)(const char*, std::size_t, std::size_t);
+			std::size_t(*_skip_word)(const char*, std::size_t, std::size_t);
+			std::size_t(*_find_string_stop)(const char*, std::size_t, std::size_t);
+			std::size_t(*_find_invalid_utf8)(const char*, std::size_t, std::size_t);
+		};
+
+		constexpr kernels_t scalar_kernels{ level::scalar, skip_dividers_scalar, skip_word_scalar, find_string_stop_scalar, find_invalid_utf8_scalar };
+#ifdef MINI_C_SIMD_X86
+		constexpr kernels_t sse2_kernels{ level::sse2, skip_dividers_sse2, skip_word_sse2, find_string_stop_sse2, find_invalid_utf8_sse2 };
+		constexpr kernels_t avx2_kernels{ level::avx2, skip_dividers_avx2, skip_word_avx2, find_string_stop_avx2, find_invalid_utf8_avx2 };
+		// the default: the scans of AVX2 are no faster than SSE2 on short tokens, its UTF-8 check is about 10 times faster
+		constexpr kernels_t default_avx2_kernels{ level::sse2, skip_dividers_sse2, skip_word_sse2, find_string_stop_sse2, find_invalid_utf8_avx2 };
+#endif
+
+		const kernels_t* kernels_for(level wanted)
+		{
+#ifdef MINI_C_SIMD_X86
+			if (wanted == level::avx2 && cpu_has_avx2()) return &avx2_kernels;
+			if (wanted != level::scalar) return &sse2_kernels;
+#endif
+			return &scalar_kernels;
+		}
+
+		const kernels_t* default_kernels()
+		{
+#ifdef MINI_C_SIMD_X86
+			return cpu_has_avx2() ? &default_avx2_kernels : &sse2_kernels;
+#else
+			return &scalar_kernels;
+#endif
+		}
+
+		// the tables are constant, so a lexer on another thread sees a whole one when `use_level()` switches
+		std::atomic<const kernels_t*> kernels{ default_kernels() };
+
+		const kernels_t& active() { return *kernels.load(std::memory_order_acquire); }
+
+	} // end anonymous namespace
+
+
+	level best_level() { return kernels_for(level::avx2)->_level; }
+
+	level active_level() { return active()._level; }
+
+	void use_level(level wanted) { kernels.store(kernels_for(wanted), std::memory_order_release); }
+
+	void use_default_level() { kernels.store(default_kernels(), std::memory_order_release); }
+
+	/*
+	 * most runs are short (one space between tokens, a short name),
+	 * so the first char is looked at before going to the kernel.
+	 */
+	std::size_t skip_dividers(const char* s, std::size_t pos, std::size_t size)
+	{
+		if (pos == size || !char_is(s[pos], char_class::divider)) return pos;
+		return active()._skip_dividers(s, pos + 1, size);
+	}
+
+	std::size_t skip_word(const char* s, std::size_t pos, std::size_t size)
+	{
+		if (pos == size || !char_is(s[pos], char_class::word)) return pos;
+		return active()._skip_word(s, pos + 1, size);
+	}
+
+	std::size_t find_string_stop(const char* s, std::size_t pos, std::size_t size)
+	{
+		return active()._find_string_stop(s, pos, size);
+	}
+
+	std::size_t find_invalid_utf8(const char* s, std::size_t size)
+	{
+		return active()._find_invalid_utf8(s, 0, size);
+	}
+
+	// `memchr()` of the C library is vectorized already, it jumps from '*' to '*'
+	std::size_t find_comment_end(const char* s, std::size_t pos, std::size_t size)
+	{
+		while (pos + 1 < size)
+		{
+			const char* star = static_cast<const char*>(std::memchr(s + pos, '*', size - 1 - pos));
+			if (star == nullptr) break;
+			pos = star - s;
+			if (s[pos + 1] == '/') return pos;
+			pos++;
+		}
+		return size;
+	}
+
+} // end namespace Mini_C::util::simd
@@ -0,0 +1,50 @@
+#pragma once
+#ifndef _SIMD_SCAN_H
+#define _SIMD_SCAN_H
+#include <cstddef>
+
+namespace Mini_C::util::simd
+{
+
+	/*
+	 * find the end of a run of chars, 16 (SSE2) or 32 (AVX2) chars at a time.
+	 *     the kernels are chosen once by what the CPU supports, the scalar ones are the fallback:
+	 *     SSE2 by default, as AVX2 does not measure clearly faster on the short runs of tokens,
+	 *     only the UTF-8 check, many times faster with AVX2, takes it if the CPU has it.
+	 *     each function looks at `s[pos, size)` only, and returns `size` if the run does not end before it.
+	 */
+	enum class level { scalar, sse2, avx2 };
+
+	level best_level();     // supported by this CPU
+	level active_level();
+
+	/*
+	 * all the kernels of one level, clamped to `best_level()`, for the tests and the benchmarks.
+	 * safe while other threads are lexing, a call on another thread takes the old kernels or the new ones.
+	 */
+	void use_level(level wanted);
+	void use_default_level();
+
+	// first char which is not ' ', '\t' or '\n'
+	std::size_t skip_dividers(const char* s, std::size_t pos, std::size_t size);
+
+	// first char which is not in [a-zA-Z0-9_] and is not a byte >= 0x80 (part of a UTF-8 name, not decoded), as `char_class::word`
+	std::size_t skip_word(const char* s, std::size_t pos, std::size_t size);
+
+	// first '"' or '\\', where a string literal stops being plain text
+	std::size_t find_string_stop(const char* s, std::size_t pos, std::size_t size);
+
+	// the '*' of the first "*/", which ends a block comment, the text between is never looked at char by char
+	std::size_t find_comment_end(const char* s, std::size_t pos, std::size_t size);
+
+	/*
+	 * the first byte of `s[0, size)` which does not start a valid UTF-8 sequence, or `size`:
+	 *     no overlong form, no surrogate, nothing above U+10FFFF, and no sequence cut at `size`.
+	 *     AVX2 checks 32 bytes at a time with table lookups, and only looks at the bytes one by one to find an error,
+	 *     SSE2 skips the ASCII blocks.
+	 */
+	std::size_t find_invalid_utf8(const char* s, std::size_t size);
+
+} // end namespace Mini_C::util::simd
+
+#endif // !_SIMD_SCAN_H
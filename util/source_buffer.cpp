@@ -0,0 +1,160 @@
+#include "source_buffer.h"
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Mini_C::util
+{
+
+	SourceBuffer::line_iterator& SourceBuffer::line_iterator::operator++()
+	{
+		if (_next == nullptr)
+		{
+			_done = true;
+			return *this;
+		}
+		_done = false;
+		const char* eol = static_cast<const char*>(std::memchr(_next, '\n', _end - _next));
+		const char* end = eol ? eol : _end;
+		std::size_t length = end - _next;
+		if (length > 0 && _next[length - 1] == '\r') length--;
+		_line = std::string_view(_next, length);
+		_next = eol ? eol + 1 : nullptr; // nullptr: this is the last line
+		return *this;
+	}
+
+
+	SourceBuffer::SourceBuffer(SourceBuffer&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	SourceBuffer& SourceBuffer::operator=(SourceBuffer&& other) noexcept
+	{
+		if (this == &other) return *this;
+		close();
+		_mapped = other._mapped;
+		_size = other._size;
+		_storage = std::move(other._storage);
+		_data = _mapped ? other._data : _storage.c_str();
+		other._data = "";
+		other._size = 0;
+		other._mapped = false;
+		return *this;
+	}
+
+
+	void SourceBuffer::close() noexcept
+	{
+		if (_mapped)
+		{
+#ifdef _WIN32
+			::UnmapViewOfFile(_data);
+#else
+			::munmap(const_cast<char*>(_data), _size);
+#endif
+		}
+		_storage.clear();
+		_data = "";
+		_size = 0;
+		_mapped = false;
+	}
+
+
+	/*
+	 * The bytes after the end of file in the last mapped page are zero,
+	 * which gives the '\0' after `_data[_size - 1]` for free.
+	 * If the file exactly fills its last page, there is no such byte,
+	 * so read it instead.
+	 */
+	bool SourceBuffer::open(const std::string& file_name)
+	{
+		close();
+
+#ifdef _WIN32
+		HANDLE file = ::CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER file_size;
+		SYSTEM_INFO info;
+		::GetSystemInfo(&info);
+		if (::GetFileType(file) == FILE_TYPE_DISK && ::GetFileSizeEx(file, &file_size)
+			&& file_size.QuadPart > 0 && file_size.QuadPart % info.dwPageSize != 0)
+		{
+			HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping != nullptr)
+			{
+				const void* view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				::CloseHandle(mapping); // the view keeps the mapping alive
+				if (view != nullptr)
+				{
+					::CloseHandle(file);
+					_data = static_cast<const char*>(view);
+					_size = static_cast<std::size_t>(file_size.QuadPart);
+					_mapped = true;
+					return true;
+				}
+			}
+		}
+		::CloseHandle(file);
+
+		std::ifstream inputFile{ file_name, std::ios::in | std::ios::binary };
+		if (!inputFile.is_open()) return false;
+		std::ostringstream content;
+		content << inputFile.rdbuf();
+		_storage = std::move(content).str();
+#else
+		const int fd = ::open(file_name.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		const long page_size = ::sysconf(_SC_PAGESIZE);
+		if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+			&& st.st_size > 0 && st.st_size % page_size != 0)
+		{
+			void* view = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (view != MAP_FAILED)
+			{
+				::close(fd);
+				_data = static_cast<const char*>(view);
+				_size = static_cast<std::size_t>(st.st_size);
+				_mapped = true;
+				return true;
+			}
+		}
+
+		// pipe, empty file, ...
+		char chunk[1 << 16];
+		for (;;)
+		{
+			const ssize_t n = ::read(fd, chunk, sizeof(chunk));
+			if (n < 0 && errno == EINTR) continue;
+			if (n < 0)
+			{
+				::close(fd);
+				_storage.clear();
+				return false;
+			}
+			if (n == 0) break;
+			_storage.append(chunk, static_cast<std::size_t>(n));
+		}
+		::close(fd);
+#endif
+		_data = _storage.c_str();
+		_size = _storage.size();
+		return true;
+	}
+
+} // end namespace Mini_C::util
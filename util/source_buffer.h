@@ -0,0 +1,86 @@
+#pragma once
+#ifndef _SOURCE_BUFFER_H
+#define _SOURCE_BUFFER_H
+#include <string>
+#include <string_view>
+#include <iterator>
+
+namespace Mini_C::util
+{
+
+	/*
+	 * Read-only content of a whole file.
+	 *     The file is mapped into memory (`mmap`, or `MapViewOfFile` on Windows),
+	 *     if it cannot be mapped (pipe, empty file, ...), it is read into memory.
+	 *
+	 * Promise: `data()[size()]` is readable and is '\0',
+	 *          so the scanners may look one char after the end.
+	 */
+	class SourceBuffer
+	{
+	public:
+
+		/*
+		 * iterate lines as `std::string_view` over the buffer.
+		 *     "\n" and "\r\n" are both line endings, the ending is not in the line.
+		 *     The char after each line is '\r', '\n' or '\0'.
+		 */
+		class line_iterator
+		{
+		public:
+			using iterator_category = std::input_iterator_tag;
+			using value_type = std::string_view;
+			using difference_type = std::ptrdiff_t;
+			using pointer = const std::string_view*;
+			using reference = const std::string_view&;
+
+			line_iterator() = default;
+			line_iterator(const char* begin, const char* end) :_next(begin), _end(end) { ++(*this); }
+			reference operator*() const { return _line; }
+			pointer operator->() const { return &_line; }
+			line_iterator& operator++();
+			bool operator==(const line_iterator& other) const { return _done == other._done && (_done || _next == other._next); }
+			bool operator!=(const line_iterator& other) const { return !(*this == other); }
+		private:
+			const char* _next = nullptr;
+			const char* _end = nullptr;
+			std::string_view _line;
+			bool _done = true;
+		};
+
+		struct line_range
+		{
+			line_iterator _begin, _end;
+			line_iterator begin() const { return _begin; }
+			line_iterator end() const { return _end; }
+		};
+
+		SourceBuffer() = default;
+		SourceBuffer(const SourceBuffer&) = delete;
+		SourceBuffer& operator=(const SourceBuffer&) = delete;
+		SourceBuffer(SourceBuffer&& other) noexcept;
+		SourceBuffer& operator=(SourceBuffer&& other) noexcept;
+		~SourceBuffer() { close(); }
+
+		// return false if the file cannot be opened
+		[[nodiscard]] bool open(const std::string& file_name);
+		void close() noexcept;
+
+		const char* data() const { return _data; }
+		std::size_t size() const { return _size; }
+		std::string_view view() const { return std::string_view(_data, _size); }
+		bool is_mapped() const { return _mapped; }
+
+		// the file always has at least one (maybe empty) line, as `std::getline` sees it
+		line_range lines() const { return line_range{ line_iterator(_data, _data + _size), line_iterator() }; }
+
+	private:
+		const char* _data = "";
+		std::size_t _size = 0;
+		bool _mapped = false;
+		std::string _storage; // used when the file is not mapped
+	};
+
+} // end namespace Mini_C::util
+
+#endif // !_SOURCE_BUFFER_H